@@ -249,7 +249,11 @@ function defaultConfigurations()
 
 	configuration "linux"
 		defines { "_GLIBCXX_USE_CXX11_ABI=0" }
-		links { "pthread" }
+		links { "pthread", "rt", "dl" }
+		-- so dladdr can symbolize functions of executables in profiler
+		linkoptions { "-rdynamic" }
+		-- sampling profiler walks the call stack through frame pointers
+		buildoptions { "-fno-omit-frame-pointer", "-mno-omit-leaf-frame-pointer" }
 
 	configuration { "vs20*"}
 		buildoptions { "/wd4503"}
@@ -709,6 +713,10 @@ if build_app then
 		end
 
 		includedirs { "../src", "../src/app" }
+		if not has_plugin("renderer") then
+			-- headless, e.g. for benchmarks on CI
+			defines { "LUMIX_NO_RENDERER" }
+		end
 		if not _OPTIONS["dynamic-plugins"] then	
 			if has_plugin("renderer") then
 				linkOpenGL()
@@ -3,6 +3,7 @@
 #include "animation/animation.h"
 #include "animation/property_animation.h"
 #include "animation/controller.h"
+#include "engine/allocators.h"
 #include "engine/engine.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
@@ -57,7 +58,7 @@ struct AnimationSystemImpl final : IPlugin
 	void serialize(OutputMemoryStream& stream) const override {}
 	bool deserialize(u32 version, InputMemoryStream& stream) override { return version == 0; }
 
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
 	Engine& m_engine;
 	AnimResourceManager<Animation> m_animation_manager;
 	AnimResourceManager<PropertyAnimation> m_property_animation_manager;
@@ -66,7 +67,7 @@ struct AnimationSystemImpl final : IPlugin
 
 
 AnimationSystemImpl::AnimationSystemImpl(Engine& engine)
-	: m_allocator(engine.getAllocator())
+	: m_allocator(engine.getAllocator(), "animation")
 	, m_engine(engine)
 	, m_animation_manager(m_allocator)
 	, m_property_animation_manager(m_allocator)
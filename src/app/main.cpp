@@ -11,20 +11,26 @@
 #include "engine/job_system.h"
 #include "engine/log.h"
 #include "engine/os.h"
+#include "engine/page_allocator.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
 #include "engine/reflection.h"
 #include "engine/resource_manager.h"
+#include "engine/stream.h"
+#include "engine/string.h"
 #include "engine/thread.h"
 #include "engine/universe.h"
-#include "gui/gui_system.h"
-#include "lua_script/lua_script_system.h"
-#include "renderer/pipeline.h"
-#include "renderer/render_scene.h"
-#include "renderer/renderer.h"
+#ifndef LUMIX_NO_RENDERER
+	#include "gui/gui_system.h"
+	#include "lua_script/lua_script_system.h"
+	#include "renderer/pipeline.h"
+	#include "renderer/render_scene.h"
+	#include "renderer/renderer.h"
+#endif
 
 using namespace Lumix;
 
+#ifndef LUMIX_NO_RENDERER
 static const ComponentType ENVIRONMENT_TYPE = reflection::getComponentType("environment");
 static const ComponentType LUA_SCRIPT_TYPE = reflection::getComponentType("lua_script");
 
@@ -38,12 +44,187 @@ struct GUIInterface : GUISystem::Interface {
 	Vec2 size;
 	Pipeline* pipeline;
 };
+#endif
+
+
+// fixed number of frames with fixed time step, results are written to json
+// headless in builds without renderer, so it can run on machines without display
+struct Benchmark {
+	struct Waypoint {
+		DVec3 pos;
+		float yaw;
+	};
+
+	struct Block {
+		Block(const char* name, IAllocator& allocator) : name(name), frame_ms(allocator) {}
+
+		const char* name;
+		u32 count = 0;
+		// total time of the block in each frame
+		Array<float> frame_ms;
+	};
+
+	struct Stat {
+		void add(double value) {
+			sum += value;
+			max = maximum(max, value);
+		}
+
+		double sum = 0;
+		double max = 0;
+	};
+
+	explicit Benchmark(IAllocator& allocator)
+		: allocator(allocator)
+		, waypoints(allocator)
+		, frame_ms(allocator)
+		, blocks(allocator)
+		, block_map(allocator)
+		, frame_totals(allocator)
+	{}
+
+	bool isRunning() const { return frames != 0; }
+
+	// camera moves through waypoints at constant pace
+	bool getCamera(Ref<DVec3> pos, Ref<Quat> rot) const {
+		if (waypoints.empty()) return false;
+		const float t = frames > 1 ? frame / float(frames - 1) * (waypoints.size() - 1) : 0;
+		const u32 idx = minimum(u32(t), (u32)waypoints.size() - 1);
+		const Waypoint& a = waypoints[idx];
+		const Waypoint& b = waypoints[minimum(idx + 1, (u32)waypoints.size() - 1)];
+		const float rel = t - idx;
+		pos = a.pos + (b.pos - a.pos) * rel;
+		rot = Quat(Vec3(0, 1, 0), degreesToRadians(a.yaw + (b.yaw - a.yaw) * rel));
+		return true;
+	}
+
+	static void onBlock(void* user_ptr, const char* name, u64 start, u64 end) {
+		Benchmark* that = (Benchmark*)user_ptr;
+		auto iter = that->block_map.find(name);
+		u32 idx;
+		if (iter.isValid()) {
+			idx = iter.value();
+		}
+		else {
+			idx = that->blocks.size();
+			that->block_map.insert(name, idx);
+			Block& block = that->blocks.emplace(name, that->allocator);
+			// block was not present in previous frames
+			for (u32 i = 0; i < that->frame; ++i) block.frame_ms.push(0);
+			that->frame_totals.push(0);
+		}
+		++that->blocks[idx].count;
+		that->frame_totals[idx] += end - start;
+	}
+
+	// called after each frame, collection is not included in frame time
+	void endFrame(u64 frame_start, u64 frame_end) {
+		const double freq = (double)os::Timer::getFrequency();
+		frame_ms.push(float((frame_end - frame_start) * 1000 / freq));
+		for (u64& t : frame_totals) t = 0;
+		profiler::forEachBlock(frame_start, frame_end, this, &onBlock);
+		for (u32 i = 0; i < (u32)blocks.size(); ++i) {
+			blocks[i].frame_ms.push(float(frame_totals[i] * 1000 / freq));
+		}
+		++frame;
+	}
+
+	static float percentile(Array<float>& values, float p) {
+		if (values.empty()) return 0;
+		qsort(values.begin(), values.size(), sizeof(values[0]), [](const void* a, const void* b) -> int {
+			const float fa = *(const float*)a;
+			const float fb = *(const float*)b;
+			return fa < fb ? -1 : (fa > fb ? 1 : 0);
+		});
+		// nearest rank
+		const u32 rank = u32(p * values.size() + 0.999f);
+		return values[clamp(rank, 1u, (u32)values.size()) - 1];
+	}
+
+	static void writeTimes(IOutputStream& out, Array<float>& values) {
+		float sum = 0;
+		for (float v : values) sum += v;
+		out << "{\"avg\":" << (values.empty() ? 0 : sum / values.size())
+			<< ",\"p50\":" << percentile(values, 0.5f)
+			<< ",\"p95\":" << percentile(values, 0.95f)
+			<< ",\"p99\":" << percentile(values, 0.99f)
+			<< ",\"max\":" << (values.empty() ? 0 : values.back())
+			<< "}";
+	}
+
+	void writeStat(IOutputStream& out, const char* name, const Stat& stat) {
+		out << ",\n\t\t\"" << name << "\":{\"avg\":" << (frame ? stat.sum / frame : 0) << ",\"max\":" << stat.max << "}";
+	}
+
+	bool save(const char* universe_path) {
+		OutputMemoryStream out(allocator);
+		out << "{\n\t\"universe\":";
+		writeJSONString(out, universe_path);
+		out << ",\n\t\"frames\":" << frame;
+		out << ",\n\t\"time_delta\":" << time_delta;
+		out << ",\n\t\"frame_ms\":";
+		writeTimes(out, frame_ms);
+		out << ",\n\t\"memory\":{";
+		out << "\n\t\t\"allocated_bytes\":" << allocated_bytes;
+		out << ",\n\t\t\"peak_allocated_bytes\":" << peak_allocated_bytes;
+		out << ",\n\t\t\"allocated_pages\":" << allocated_pages;
+		out << ",\n\t\t\"reserved_pages\":" << reserved_pages;
+		out << ",\n\t\t\"resources_bytes\":" << resources_bytes;
+		out << "\n\t},\n\t\"draw\":{";
+		out << "\n\t\t\"frames\":" << frame;
+		writeStat(out, "draw_calls", draw_calls);
+		writeStat(out, "instances", instances);
+		writeStat(out, "triangles", triangles);
+		out << "\n\t},\n\t\"blocks\":[";
+		for (Block& block : blocks) {
+			out << (&block == blocks.begin() ? "\n\t\t{\"name\":" : ",\n\t\t{\"name\":");
+			writeJSONString(out, block.name);
+			out << ",\"count\":" << block.count << ",\"frame_ms\":";
+			writeTimes(out, block.frame_ms);
+			out << "}";
+		}
+		out << "\n\t]\n}\n";
+
+		os::OutputFile file;
+		if (!file.open(path)) {
+			logError("Could not create ", path);
+			return false;
+		}
+		const bool res = file.write(out.data(), out.size());
+		file.close();
+		if (!res) logError("Could not write ", path);
+		else logInfo("Benchmark results written to ", path);
+		return res;
+	}
+
+	IAllocator& allocator;
+	u32 frames = 0;
+	u32 frame = 0;
+	float time_delta = 1 / 60.f;
+	StaticString<LUMIX_MAX_PATH> path = "benchmark.json";
+	Array<Waypoint> waypoints;
+
+	Array<float> frame_ms;
+	Array<Block> blocks;
+	HashMap<const char*, u32> block_map;
+	// indexed same as blocks
+	Array<u64> frame_totals;
+	Stat draw_calls;
+	Stat instances;
+	Stat triangles;
+	u64 allocated_bytes = 0;
+	u64 peak_allocated_bytes = 0;
+	u64 allocated_pages = 0;
+	u64 reserved_pages = 0;
+	u64 resources_bytes = 0;
+};
 
 
 struct Runner final
 {
 	Runner() 
 		: m_allocator(m_main_allocator) 
+		, m_benchmark(m_allocator)
 	{
 		if (!jobs::init(os::getCPUsCount(), m_allocator)) {
 			logError("Failed to initialize job system.");
@@ -55,6 +236,7 @@ struct Runner final
 		ASSERT(!m_universe); 
 	}
 
+	#ifndef LUMIX_NO_RENDERER
 	void onResize() {
 		if (!m_engine.get()) return;
 		if (m_engine->getWindowHandle() == os::INVALID_WINDOW) return;
@@ -102,6 +284,114 @@ struct Runner final
 		lua_scene->addScript(env, 0);
 		lua_scene->setScriptPath(env, 0, Path("pipelines/atmo.lua"));
 	}
+	#endif
+
+	// -profile_frames <count> or -profile_ms <duration> records a trace after the game starts,
+	// writes it to -profile_out <path> (trace.json by default) and quits
+	// -benchmark <frames> runs the game with fixed time step -benchmark_dt <ms> (1000/60 by default),
+	// writes stats to -benchmark_out <path> (benchmark.json by default) and quits
+	// -benchmark_camera <x,y,z,yaw> adds camera waypoint, if there are none, the game camera is used
+	// -universe <path> loads the universe instead of universes/main.unv
+	void parseCommandLine() {
+		char cmd_line[2048];
+		os::getCommandLine(Span(cmd_line));
+		CommandLineParser parser(cmd_line);
+		while (parser.next()) {
+			const bool is_frames = parser.currentEquals("-profile_frames");
+			const bool is_ms = parser.currentEquals("-profile_ms");
+			const bool is_out = parser.currentEquals("-profile_out");
+			const bool is_benchmark = parser.currentEquals("-benchmark");
+			const bool is_benchmark_dt = parser.currentEquals("-benchmark_dt");
+			const bool is_benchmark_out = parser.currentEquals("-benchmark_out");
+			const bool is_benchmark_camera = parser.currentEquals("-benchmark_camera");
+			const bool is_universe = parser.currentEquals("-universe");
+			if (!is_frames && !is_ms && !is_out && !is_benchmark && !is_benchmark_dt && !is_benchmark_out && !is_benchmark_camera && !is_universe) continue;
+			if (!parser.next()) {
+				logError("Command line option without value");
+				break;
+			}
+
+			char tmp[LUMIX_MAX_PATH];
+			parser.getCurrent(tmp, lengthOf(tmp));
+			if (is_out) m_capture.path = tmp;
+			else if (is_frames) fromCString(Span(tmp, stringLength(tmp)), Ref(m_capture.frames));
+			else if (is_ms) fromCString(Span(tmp, stringLength(tmp)), Ref(m_capture.ms));
+			else if (is_benchmark) fromCString(Span(tmp, stringLength(tmp)), Ref(m_benchmark.frames));
+			else if (is_benchmark_dt) m_benchmark.time_delta = float(atof(tmp) / 1000);
+			else if (is_benchmark_out) m_benchmark.path = tmp;
+			else if (is_universe) m_universe_path = tmp;
+			else {
+				double values[4] = {};
+				char* value = tmp;
+				for (double& v : values) {
+					char* comma = value;
+					while (*comma && *comma != ',') ++comma;
+					const bool last = *comma == '\0';
+					*comma = '\0';
+					v = atof(value);
+					if (last) break;
+					value = comma + 1;
+				}
+				m_benchmark.waypoints.push({DVec3(values[0], values[1], values[2]), (float)values[3]});
+			}
+		}
+	}
+
+	void updateBenchmark(u64 frame_start) {
+		if (!m_benchmark.isRunning()) return;
+
+		const u64 frame_end = os::Timer::getRawTimestamp();
+		m_benchmark.endFrame(frame_start, frame_end);
+
+		#ifndef LUMIX_NO_RENDERER
+			const Pipeline::Stats& stats = m_pipeline->getStats();
+			m_benchmark.draw_calls.add(stats.draw_call_count);
+			m_benchmark.instances.add(stats.instance_count);
+			m_benchmark.triangles.add(stats.triangle_count);
+		#endif
+		m_benchmark.peak_allocated_bytes = maximum(m_benchmark.peak_allocated_bytes, (u64)m_allocator.getTotalSize());
+
+		if (m_benchmark.frame < m_benchmark.frames) return;
+
+		m_benchmark.allocated_bytes = m_allocator.getTotalSize();
+		const PageAllocator& page_allocator = m_engine->getPageAllocator();
+		m_benchmark.allocated_pages = page_allocator.getAllocatedCount();
+		m_benchmark.reserved_pages = page_allocator.getReservedCount();
+		m_benchmark.resources_bytes = m_engine->getResourceManager().getResidentSize();
+		m_benchmark.save(m_universe_path);
+		m_benchmark.frames = 0;
+		m_finished = true;
+	}
+
+	void updateCapture() {
+		if (m_capture.frames == 0 && m_capture.ms == 0) return;
+
+		const u64 now = os::Timer::getRawTimestamp();
+		if (m_capture.start == 0) {
+			m_capture.start = now;
+			logInfo("Capturing trace");
+			return;
+		}
+
+		++m_capture.captured_frames;
+		const bool frames_done = m_capture.frames != 0 && m_capture.captured_frames >= m_capture.frames;
+		const bool time_done = m_capture.ms != 0 && (now - m_capture.start) * 1000 >= m_capture.ms * os::Timer::getFrequency();
+		if (!frames_done && !time_done) return;
+
+		OutputMemoryStream trace(m_allocator);
+		profiler::exportChromeTrace(trace, m_capture.start, now);
+		os::OutputFile file;
+		if (!file.open(m_capture.path)) {
+			logError("Could not create ", m_capture.path);
+		}
+		else {
+			if (!file.write(trace.data(), trace.size())) logError("Could not write ", m_capture.path);
+			else logInfo("Trace with ", m_capture.captured_frames, " frames written to ", m_capture.path);
+			file.close();
+		}
+		m_capture.frames = m_capture.ms = 0;
+		m_finished = true;
+	}
 
 	bool loadUniverse(const char* path) {
 		FileSystem& fs = m_engine->getFileSystem();
@@ -128,23 +418,34 @@ struct Runner final
 	}
 
 	void onInit() {
+		parseCommandLine();
 		Engine::InitArgs init_data;
+		#ifdef LUMIX_NO_RENDERER
+			init_data.headless = true;
+		#endif
 
 		if (os::fileExists("main.pak")) {
 			init_data.file_system = FileSystem::createPacked("main.pak", m_allocator);
 		}
 
 		m_engine = Engine::create(static_cast<Engine::InitArgs&&>(init_data), m_allocator);
+		if (m_benchmark.isRunning()) m_engine->setFixedTimeDelta(m_benchmark.time_delta);
 
 		m_universe = &m_engine->createUniverse(true);
-		initRenderPipeline();
-		
-		auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
-		m_gui_interface.pipeline = m_pipeline.get();
-		gui->setInterface(&m_gui_interface);
-
-		if (!loadUniverse("universes/main.unv")) {
-			initDemoScene();
+		#ifndef LUMIX_NO_RENDERER
+			initRenderPipeline();
+			
+			auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
+			m_gui_interface.pipeline = m_pipeline.get();
+			gui->setInterface(&m_gui_interface);
+		#endif
+
+		if (!loadUniverse(m_universe_path)) {
+			#ifndef LUMIX_NO_RENDERER
+				initDemoScene();
+			#else
+				logError("Could not load ", m_universe_path);
+			#endif
 		}
 		while (m_engine->getFileSystem().hasWork()) {
 			os::sleep(10);
@@ -152,16 +453,20 @@ struct Runner final
 		}
 		m_engine->getFileSystem().processCallbacks();
 
-		os::showCursor(false);
-		onResize();
+		#ifndef LUMIX_NO_RENDERER
+			os::showCursor(false);
+			onResize();
+		#endif
 		m_engine->startGame(*m_universe);
 	}
 
 	void shutdown() {
 		m_engine->destroyUniverse(*m_universe);
-		auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
-		gui->setInterface(nullptr);
-		m_pipeline.reset();
+		#ifndef LUMIX_NO_RENDERER
+			auto* gui = static_cast<GUISystem*>(m_engine->getPluginManager().getPlugin("gui"));
+			gui->setInterface(nullptr);
+			m_pipeline.reset();
+		#endif
 		m_engine.reset();
 		m_universe = nullptr;
 	}
@@ -176,40 +481,60 @@ struct Runner final
 			case os::Event::Type::WINDOW_CLOSE: 
 				m_finished = true;
 				break;
-			case os::Event::Type::WINDOW_MOVE:
-			case os::Event::Type::WINDOW_SIZE:
-				onResize();
-				break;
+			#ifndef LUMIX_NO_RENDERER
+				case os::Event::Type::WINDOW_MOVE:
+				case os::Event::Type::WINDOW_SIZE:
+					onResize();
+					break;
+			#endif
 		}
 	}
 
 	void onIdle() {
+		const u64 frame_start = os::Timer::getRawTimestamp();
 		m_engine->update(*m_universe);
 
-		EntityPtr camera = m_pipeline->getScene()->getActiveCamera();
-		if (camera.isValid()) {
-			int w = m_viewport.w;
-			int h = m_viewport.h;
-			m_viewport = m_pipeline->getScene()->getCameraViewport((EntityRef)camera);
-			m_viewport.w = w;
-			m_viewport.h = h;
-		}
-
-		m_pipeline->setViewport(m_viewport);
-		m_pipeline->render(false);
-		m_renderer->frame();
+		#ifndef LUMIX_NO_RENDERER
+			EntityPtr camera = m_pipeline->getScene()->getActiveCamera();
+			if (camera.isValid()) {
+				int w = m_viewport.w;
+				int h = m_viewport.h;
+				m_viewport = m_pipeline->getScene()->getCameraViewport((EntityRef)camera);
+				m_viewport.w = w;
+				m_viewport.h = h;
+			}
+			if (m_benchmark.isRunning()) m_benchmark.getCamera(Ref(m_viewport.pos), Ref(m_viewport.rot));
+
+			m_pipeline->setViewport(m_viewport);
+			m_pipeline->render(false);
+			m_renderer->frame();
+		#endif
+		profiler::frame();
+		updateBenchmark(frame_start);
+		updateCapture();
 	}
 
 	DefaultAllocator m_main_allocator;
 	debug::Allocator m_allocator;
 	UniquePtr<Engine> m_engine;
-	Renderer* m_renderer = nullptr;
 	Universe* m_universe = nullptr;
-	UniquePtr<Pipeline> m_pipeline;
+	#ifndef LUMIX_NO_RENDERER
+		Renderer* m_renderer = nullptr;
+		UniquePtr<Pipeline> m_pipeline;
+		Viewport m_viewport;
+		GUIInterface m_gui_interface;
+	#endif
 
-	Viewport m_viewport;
 	bool m_finished = false;
-	GUIInterface m_gui_interface;
+	StaticString<LUMIX_MAX_PATH> m_universe_path = "universes/main.unv";
+	Benchmark m_benchmark;
+	struct {
+		u32 frames = 0;
+		u32 ms = 0;
+		u32 captured_frames = 0;
+		u64 start = 0;
+		StaticString<LUMIX_MAX_PATH> path = "trace.json";
+	} m_capture;
 };
 
 int main(int args, char* argv[])
@@ -16,6 +16,7 @@
 #include "engine/os.h"
 #include "engine/path.h"
 #include "engine/profiler.h"
+#include "engine/queue.h"
 #include "engine/resource.h"
 #include "engine/resource_manager.h"
 
@@ -90,7 +91,6 @@ struct AssetCompilerImpl : AssetCompiler
 		, m_plugins(app.getAllocator())
 		, m_task(*this, app.getAllocator())
 		, m_to_compile(app.getAllocator())
-		, m_compiled(app.getAllocator())
 		, m_semaphore(0, 0x7fFFffFF)
 		, m_registered_extensions(app.getAllocator())
 		, m_resources(app.getAllocator())
@@ -142,6 +142,9 @@ struct AssetCompilerImpl : AssetCompiler
 		m_task.m_finished = true;
 		m_to_compile.emplace();
 		m_semaphore.signal();
+		// unblock compiler thread if it waits for free space in m_compiled
+		Path tmp;
+		while (m_compiled.tryPop(tmp)) {}
 		m_task.destroy();
 		ResourceManagerHub& rm = m_app.getEngine().getResourceManager();
 		rm.setLoadHook(nullptr);
@@ -525,10 +528,8 @@ struct AssetCompilerImpl : AssetCompiler
 
 	Path popCompiledResource()
 	{
-		MutexGuard lock(m_compiled_mutex);
-		if(m_compiled.empty()) return Path();
-		const Path p = m_compiled.back();
-		m_compiled.pop();
+		Path p;
+		if (!m_compiled.tryPop(p)) return Path();
 		--m_batch_remaining_count;
 		if (m_batch_remaining_count == 0) m_compile_batch_count = 0;
 		return p;
@@ -593,9 +594,6 @@ struct AssetCompilerImpl : AssetCompiler
 			Path p = popCompiledResource();
 			if (!p.isValid()) break;
 
-			// this can take some time, mutex is probably not the best option
-			MutexGuard lock(m_compiled_mutex);
-
 			for (Resource* r : m_to_compile_subresources[p]) {
 				m_load_hook.continueLoad(*r);
 			}
@@ -683,14 +681,14 @@ struct AssetCompilerImpl : AssetCompiler
 
 	Semaphore m_semaphore;
 	Mutex m_to_compile_mutex;
-	Mutex m_compiled_mutex;
 	Mutex m_plugin_mutex;
 	Mutex m_changed_mutex;
 	HashMap<Path, Array<Resource*>> m_to_compile_subresources; 
 	HashMap<Path, Array<Path>> m_dependencies;
 	Array<Path> m_changed_files;
 	Array<Path> m_to_compile;
-	Array<Path> m_compiled;
+	// compiler thread blocks if this is full, so it can't run too far ahead of main thread
+	BlockingQueue<SPSCQueue<Path, 64>> m_compiled;
 	StudioApp& m_app;
 	LoadHook m_load_hook;
 	HashMap<u32, IPlugin*, HashFuncDirect<u32>> m_plugins;
@@ -725,7 +723,6 @@ int AssetCompilerTask::task()
 			if (!compiled) {
 				logError("Failed to compile resource ", p);
 			}
-			MutexGuard lock(m_compiler.m_compiled_mutex);
 			m_compiler.m_compiled.push(p);
 		}
 	}
@@ -6,6 +6,7 @@
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/file_system.h"
+#include "engine/hash.h"
 #include "engine/atomic.h"
 #include "engine/job_system.h"
 #include "engine/log.h"
@@ -79,6 +80,7 @@ struct ThreadContextProxy {
 
 static const char* getContexSwitchReasonString(i8 reason)
 {
+	#ifdef _WIN32
 	const char* reasons[] = {
 		"Executive"		   ,
 		"FreePage"		   ,
@@ -119,7 +121,21 @@ static const char* getContexSwitchReasonString(i8 reason)
 		"WrRundown"		   ,
 		"MaximumWaitReason",
 	};
-	if (reason >= (i8)lengthOf(reasons)) return "Unknown";
+	#else
+	// state of the thread which was switched out, see getSwitchReason in profiler.cpp
+	const char* reasons[] = {
+		"Preempted",
+		"Sleeping",
+		"Uninterruptible sleep",
+		"Stopped",
+		"Traced",
+		"Dead",
+		"Zombie",
+		"Parked",
+		"Idle",
+	};
+	#endif
+	if (reason < 0 || reason >= (i8)lengthOf(reasons)) return "Unknown";
 	return reasons[reason];
 }
 
@@ -171,6 +187,10 @@ struct ProfilerUIImpl final : ProfilerUI
 		: m_main_allocator(allocator)
 		, m_threads(m_allocator)
 		, m_data(m_allocator)
+		, m_flame_nodes(m_allocator)
+		, m_symbols(m_allocator)
+		, m_symbol_names(m_allocator)
+		, m_symbol_name_map(m_allocator)
 		, m_resource_manager(engine.getResourceManager())
 		, m_engine(engine)
 	{
@@ -264,6 +284,13 @@ struct ProfilerUIImpl final : ProfilerUI
 						overwrite(ctx, u32(p + sizeof(profiler::EventHeader)), r);
 						break;
 					}
+					case profiler::EventType::COUNTER: {
+						profiler::CounterRecord r;
+						read(ctx, p + sizeof(profiler::EventHeader), (u8*)&r, sizeof(r));
+						r.name = map[r.name];
+						overwrite(ctx, u32(p + sizeof(profiler::EventHeader)), r);
+						break;
+					}
 					default: break;
 				}
 				p += header.size;
@@ -383,7 +410,12 @@ struct ProfilerUIImpl final : ProfilerUI
 
 
 	void onGUICPUProfiler();
+	void onGUIFlameGraph(const ThreadContextProxy& global, u64 from, u64 to);
+	void onGUICounters(const ThreadContextProxy& global, u64 from, u64 to, float from_x, float to_x);
+	void drawFlameNode(u32 node_idx, float x, float y, float w, u32 total);
+	u32 getSymbol(void* address);
 	void onGUIMemoryProfiler();
+	void onGUIMemoryTags();
 	void onGUIResources();
 	void onFrame();
 	void addToTree(debug::Allocator::AllocationInfo* info);
@@ -419,6 +451,19 @@ struct ProfilerUIImpl final : ProfilerUI
 	i64 hovered_link = 0;
 	profiler::GPUMemStatsBlock m_gpu_mem_stats;
 	bool m_is_gpu_mem_stats_valid = false;
+
+	// call tree built from samples, siblings are linked lists
+	struct FlameNode {
+		u32 symbol;
+		u32 count;
+		u32 first_child;
+		u32 next_sibling;
+	};
+	Array<FlameNode> m_flame_nodes;
+	// address -> index in m_symbol_names, addresses in the same function share the name
+	HashMap<u64, u32> m_symbols;
+	Array<StaticString<128>> m_symbol_names;
+	HashMap<u64, u32> m_symbol_name_map;
 };
 
 
@@ -644,7 +689,11 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 	}
 	const PageAllocator& page_allocator = m_engine.getPageAllocator();
 	const float reserved_pages_size = (page_allocator.getReservedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
-	ImGui::Text("Page allocator: %.3fMB", reserved_pages_size);
+	const float allocated_pages_size = (page_allocator.getAllocatedCount() * PageAllocator::PAGE_SIZE) / (1024.f * 1024.f);
+	ImGui::Text("Page allocator: %.3fMB / %.3fMB", allocated_pages_size, reserved_pages_size);
+	ImGui::SameLine();
+	if (ImGui::Button("Trim")) m_engine.getPageAllocator().trim();
+	onGUIMemoryTags();
 
 	if (m_is_gpu_mem_stats_valid) {
 		const float current = m_gpu_mem_stats.current / (1024.f * 1024.f);
@@ -666,6 +715,57 @@ void ProfilerUIImpl::onGUIMemoryProfiler()
 	ImGui::Columns(1);
 }
 
+void ProfilerUIImpl::onGUIMemoryTags()
+{
+	if (!ImGui::TreeNode("Tags")) return;
+
+	ImGui::Columns(6, "memtags");
+	ImGui::Text("Tag"); ImGui::NextColumn();
+	ImGui::Text("Current"); ImGui::NextColumn();
+	ImGui::Text("Peak"); ImGui::NextColumn();
+	ImGui::Text("Allocs / frame"); ImGui::NextColumn();
+	ImGui::Text("Bytes / frame"); ImGui::NextColumn();
+	ImGui::Text("Capture callstacks"); ImGui::NextColumn();
+	ImGui::Separator();
+	for (TagAllocator* tag = TagAllocator::getFirst(); tag; tag = tag->getNext()) {
+		ImGui::PushID(tag);
+		ImGui::TextUnformatted(tag->getName()); ImGui::NextColumn();
+		ImGui::Text("%.3fMB", tag->getCurrentSize() / (1024.f * 1024.f)); ImGui::NextColumn();
+		ImGui::Text("%.3fMB", tag->getPeakSize() / (1024.f * 1024.f)); ImGui::NextColumn();
+		ImGui::Text("%d", tag->getFrameAllocationsCount()); ImGui::NextColumn();
+		ImGui::Text("%.1fKB", tag->getFrameAllocatedSize() / 1024.f); ImGui::NextColumn();
+		bool capture = tag->isCallstackCaptureEnabled();
+		if (ImGui::Checkbox("##capture", &capture)) tag->enableCallstackCapture(capture);
+		ImGui::NextColumn();
+		ImGui::PopID();
+	}
+	ImGui::Columns(1);
+
+	for (TagAllocator* tag = TagAllocator::getFirst(); tag; tag = tag->getNext()) {
+		if (!tag->isCallstackCaptureEnabled()) continue;
+		if (!ImGui::TreeNode(tag, "%s live callstacks", tag->getName())) continue;
+
+		TagAllocator::LiveCallstack callstacks[64];
+		const u32 total = tag->getLiveCallstacks(Span(callstacks));
+		for (u32 i = 0; i < minimum(total, (u32)lengthOf(callstacks)); ++i) {
+			const TagAllocator::LiveCallstack& cs = callstacks[i];
+			if (ImGui::TreeNode(cs.stack, "%.1fKB in %d allocations", cs.size / 1024.f, cs.count)) {
+				char fn_name[256];
+				int line;
+				for (debug::StackNode* node = cs.stack; node; node = debug::StackTree::getParent(node)) {
+					if (!debug::StackTree::getFunction(node, Span(fn_name), Ref(line))) copyString(fn_name, "N/A");
+					if (line >= 0) ImGui::Text("%s %d", fn_name, line);
+					else ImGui::TextUnformatted(fn_name);
+				}
+				ImGui::TreePop();
+			}
+		}
+		if (total > lengthOf(callstacks)) ImGui::Text("%d more callstacks", total - lengthOf(callstacks));
+		ImGui::TreePop();
+	}
+	ImGui::TreePop();
+}
+
 static void renderArrow(ImVec2 p_min, ImGuiDir dir, float scale, ImDrawList* dl)
 {
 	const float h = ImGui::GetFontSize() * 1.00f;
@@ -737,6 +837,10 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			});
 			ImGui::EndMenu();
 		}
+		bool sampling = profiler::isSamplingEnabled();
+		if (ImGui::Checkbox("Sampling", &sampling)) {
+			if (!profiler::enableSampling(sampling)) logError("Could not enable sampling profiler");
+		}
 		if (profiler::contextSwitchesEnabled())
 		{
 			ImGui::Checkbox("Show context switches", &m_show_context_switches);
@@ -744,7 +848,11 @@ void ProfilerUIImpl::onGUICPUProfiler()
 		else {
 			ImGui::Separator();
 			ImGui::Text("Context switch tracing not available.");
-			ImGui::Text("Run the app as an administrator.");
+			#ifdef _WIN32
+				ImGui::Text("Run the app as an administrator.");
+			#else
+				ImGui::Text("It needs CAP_PERFMON or kernel.perf_event_paranoid = -1 and mounted tracefs.");
+			#endif
 		}
 		ImGui::EndMenu();
 	}
@@ -1119,6 +1227,9 @@ void ProfilerUIImpl::onGUICPUProfiler()
 						dl->AddLine(ImVec2(x, from_y), ImVec2(x, before_gpu_y), 0xffff0000);
 					}
 					break;
+				case profiler::EventType::SAMPLES:
+				case profiler::EventType::COUNTER:
+					break;
 				case profiler::EventType::CONTEXT_SWITCH:
 					if (m_show_context_switches && header.time >= view_start && header.time <= m_end) {
 						profiler::ContextSwitchRecord r;
@@ -1167,6 +1278,224 @@ void ProfilerUIImpl::onGUICPUProfiler()
 			dl->AddLine(ImVec2(to_x, tr.y + 10), ImVec2(x, tr.y + 10), 0xff00ff00);
 		}
 	}
+
+	onGUICounters(global, view_start, m_end, from_x, to_x);
+	onGUIFlameGraph(global, view_start, m_end);
+}
+
+
+void ProfilerUIImpl::onGUICounters(const ThreadContextProxy& global, u64 from, u64 to, float from_x, float to_x) {
+	if (!ImGui::TreeNode("Counters")) return;
+
+	// names are patched to point into m_data, so the pointer identifies the counter
+	Array<const char*> names(m_allocator);
+	u32 p = global.begin;
+	const u32 end = global.end;
+	while (p != end) {
+		profiler::EventHeader header;
+		read(global, p, header);
+		if (header.type == profiler::EventType::COUNTER) {
+			profiler::CounterRecord r;
+			read(global, p + sizeof(header), r);
+			if (names.indexOf(r.name) < 0) names.push(r.name);
+		}
+		p += header.size;
+	}
+	if (names.empty()) ImGui::TextUnformatted("No counters, see profiler::counter");
+
+	ImDrawList* dl = ImGui::GetWindowDrawList();
+	const float height = 40;
+	auto get_x = [&](u64 time){
+		const float t = float(i64(time - from) / double(to - from));
+		return from_x * (1 - t) + to_x * t;
+	};
+	for (const char* name : names) {
+		// value range of the whole capture, so plot does not jump while scrolling
+		double range_min = DBL_MAX, range_max = -DBL_MAX;
+		double view_min = DBL_MAX, view_max = -DBL_MAX, view_sum = 0;
+		u32 view_count = 0;
+		p = global.begin;
+		while (p != end) {
+			profiler::EventHeader header;
+			read(global, p, header);
+			if (header.type == profiler::EventType::COUNTER) {
+				profiler::CounterRecord r;
+				read(global, p + sizeof(header), r);
+				if (r.name == name) {
+					range_min = minimum(range_min, r.min);
+					range_max = maximum(range_max, r.max);
+					if (header.time >= from && header.time <= to) {
+						view_min = minimum(view_min, r.min);
+						view_max = maximum(view_max, r.max);
+						view_sum += r.avg;
+						++view_count;
+					}
+				}
+			}
+			p += header.size;
+		}
+
+		if (view_count > 0) {
+			ImGui::Text("%s - min: %.2f, avg: %.2f, max: %.2f", name, view_min, view_sum / view_count, view_max);
+		}
+		else {
+			ImGui::Text("%s - no values in the visible range", name);
+		}
+		const float top = ImGui::GetCursorScreenPos().y;
+		const float bottom = top + height;
+		dl->AddRectFilled(ImVec2(from_x, top), ImVec2(to_x, bottom), ImGui::GetColorU32(ImGuiCol_FrameBg));
+		const double range = range_max > range_min ? range_max - range_min : 1;
+		auto get_y = [&](double value){
+			return bottom - float((value - range_min) / range) * (height - 2) - 1;
+		};
+
+		ImVec2 prev;
+		bool has_prev = false;
+		bool tooltip_shown = false;
+		p = global.begin;
+		while (p != end) {
+			profiler::EventHeader header;
+			read(global, p, header);
+			if (header.type == profiler::EventType::COUNTER && header.time >= from && header.time <= to) {
+				profiler::CounterRecord r;
+				read(global, p + sizeof(header), r);
+				if (r.name == name) {
+					const float x = get_x(header.time);
+					if (r.min != r.max) dl->AddLine(ImVec2(x, get_y(r.min)), ImVec2(x, get_y(r.max)), 0x80ffffff);
+					const ImVec2 cur(x, get_y(r.avg));
+					if (has_prev) dl->AddLine(prev, cur, 0xff00ff00);
+					if (!tooltip_shown && ImGui::IsMouseHoveringRect(ImVec2(x - 3, top), ImVec2(x + 3, bottom))) {
+						ImGui::BeginTooltip();
+						ImGui::Text("%s", name);
+						ImGui::Text("min: %f", r.min);
+						ImGui::Text("avg: %f", r.avg);
+						ImGui::Text("max: %f", r.max);
+						ImGui::EndTooltip();
+						tooltip_shown = true;
+					}
+					prev = cur;
+					has_prev = true;
+				}
+			}
+			p += header.size;
+		}
+		ImGui::Dummy(ImVec2(to_x - from_x, height));
+	}
+	ImGui::TreePop();
+}
+
+
+u32 ProfilerUIImpl::getSymbol(void* address) {
+	auto iter = m_symbols.find((u64)(uintptr)address);
+	if (iter.isValid()) return iter.value();
+
+	// symbols are resolved in this process, so it does not work with data loaded from a different build
+	char name[128];
+	int line;
+	if (!debug::StackTree::getFunction(address, Span(name), Ref(line))) {
+		toCString((u64)(uintptr)address, Span(name));
+	}
+	const u64 name_hash = hash64(name, stringLength(name));
+	auto name_iter = m_symbol_name_map.find(name_hash);
+	u32 idx;
+	if (name_iter.isValid()) {
+		idx = name_iter.value();
+	}
+	else {
+		idx = m_symbol_names.size();
+		m_symbol_names.emplace(name);
+		m_symbol_name_map.insert(name_hash, idx);
+	}
+	m_symbols.insert((u64)(uintptr)address, idx);
+	return idx;
+}
+
+
+void ProfilerUIImpl::drawFlameNode(u32 node_idx, float x, float y, float w, u32 total) {
+	ImDrawList* dl = ImGui::GetWindowDrawList();
+	for (u32 i = node_idx; i != 0xffFFffFF; i = m_flame_nodes[i].next_sibling) {
+		const FlameNode& node = m_flame_nodes[i];
+		const float node_w = w * node.count / float(total);
+		const char* name = m_symbol_names[node.symbol].data;
+		if (node_w >= 1) {
+			const ImVec2 ra(x, y);
+			const ImVec2 rb(x + node_w, y + 19);
+			const u32 hue = (u32)hash64(name, stringLength(name));
+			const u32 color = 0xff000000 | (0x80 + (hue & 0x7f)) | ((0x40 + ((hue >> 8) & 0x3f)) << 8) | (0x20 << 16);
+			dl->AddRectFilled(ra, rb, color);
+			if (node_w > 2) dl->AddRect(ra, rb, ImGui::GetColorU32(ImGuiCol_Border));
+			if (ImGui::CalcTextSize(name).x + 2 < node_w) {
+				dl->PushClipRect(ra, rb, true);
+				dl->AddText(ImVec2(x + 2, y), 0xff000000, name);
+				dl->PopClipRect();
+			}
+			if (ImGui::IsMouseHoveringRect(ra, rb)) {
+				ImGui::BeginTooltip();
+				ImGui::Text("%s", name);
+				ImGui::Text("%d samples (%.2f %%)", node.count, 100.f * node.count / total);
+				ImGui::EndTooltip();
+			}
+			if (node.first_child != 0xffFFffFF) drawFlameNode(node.first_child, x, y + 20, w, total);
+		}
+		x += node_w;
+	}
+}
+
+
+void ProfilerUIImpl::onGUIFlameGraph(const ThreadContextProxy& global, u64 from, u64 to) {
+	if (!ImGui::TreeNode("Flame graph")) return;
+
+	// rebuilt every frame, the view range can change
+	m_flame_nodes.clear();
+	// root
+	m_flame_nodes.push({0xffFFffFF, 0, 0xffFFffFF, 0xffFFffFF});
+	u32 max_depth = 0;
+	u32 p = global.begin;
+	const u32 end = global.end;
+	while (p != end) {
+		profiler::EventHeader header;
+		read(global, p, header);
+		if (header.type == profiler::EventType::SAMPLES && header.time >= from && header.time <= to) {
+			profiler::SampleRecord rec;
+			read(global, p + sizeof(header), rec);
+			auto thread = m_threads.find(rec.thread_id);
+			if (!thread.isValid() || thread.value().show) {
+				void* frames[64];
+				const u32 frames_count = minimum(rec.frames_count, (u32)lengthOf(frames));
+				read(global, p + sizeof(header) + sizeof(rec), (u8*)frames, frames_count * sizeof(frames[0]));
+				m_flame_nodes[0].count += rec.count;
+				u32 parent = 0;
+				// innermost frame is first, tree goes from outermost
+				for (i32 i = frames_count - 1; i >= 0; --i) {
+					const u32 symbol = getSymbol(frames[i]);
+					u32 child = m_flame_nodes[parent].first_child;
+					while (child != 0xffFFffFF && m_flame_nodes[child].symbol != symbol) child = m_flame_nodes[child].next_sibling;
+					if (child == 0xffFFffFF) {
+						child = m_flame_nodes.size();
+						m_flame_nodes.push({symbol, 0, 0xffFFffFF, m_flame_nodes[parent].first_child});
+						m_flame_nodes[parent].first_child = child;
+					}
+					m_flame_nodes[child].count += rec.count;
+					parent = child;
+				}
+				max_depth = maximum(max_depth, frames_count);
+			}
+		}
+		p += header.size;
+	}
+
+	const u32 total = m_flame_nodes[0].count;
+	if (total == 0) {
+		ImGui::TextUnformatted(profiler::isSamplingEnabled() ? "No samples in the visible range." : "Enable sampling in Advanced menu.");
+	}
+	else {
+		ImGui::Text("%d samples", total);
+		const ImVec2 pos = ImGui::GetCursorScreenPos();
+		const float w = ImGui::GetContentRegionAvail().x;
+		drawFlameNode(m_flame_nodes[0].first_child, pos.x, pos.y, w, total);
+		ImGui::Dummy(ImVec2(w, max_depth * 20.f));
+	}
+	ImGui::TreePop();
 }
 
 
@@ -1,21 +1,28 @@
 #include "engine/allocators.h"
+#include "engine/array.h"
 #include "engine/atomic.h"
 #include "engine/crt.h"
+#include "engine/debug.h"
+#include "engine/hash_map.h"
 #include "engine/math.h"
 #include "engine/os.h"
 #ifndef _WIN32
 	#include <string.h>
 	#include <malloc.h>
-#else
-	#include <intrin.h>
 #endif
 
 
 namespace Lumix
 {
-	static constexpr u32 PAGE_SIZE = 4096;
-	static constexpr size_t MAX_PAGE_COUNT = 16384;
-	static constexpr u32 SMALL_ALLOC_MAX_SIZE = 64;
+	static constexpr u32 PAGE_SIZE = 16384;
+	// only address space, pages are committed when needed and decommitted when empty
+	static constexpr size_t MAX_PAGE_COUNT = 1024 * 1024;
+	static constexpr u32 SMALL_ALLOC_MAX_SIZE = 4096;
+	// empty pages stay in their bins up to this count, so alloc/free patterns around page boundary don't decommit/reinit pages all the time
+	static constexpr u32 MAX_EMPTY_PAGES = 16;
+	// ~1.5x apart, so at most ~1/3 of an item is wasted
+	static constexpr u32 SIZE_CLASSES[] = { 8, 16, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048, 3072, 4096 };
+	static_assert(lengthOf(SIZE_CLASSES) == DefaultAllocator::BINS_COUNT);
 
 	struct DefaultAllocator::Page {
 		struct Header {
@@ -23,6 +30,7 @@ namespace Lumix
 			Page* next;
 			u32 first_free;
 			u32 item_size;
+			u32 allocated_count;
 		};
 		u8 data[PAGE_SIZE - sizeof(Header)];
 		Header header;
@@ -30,24 +38,37 @@ namespace Lumix
 
 	static_assert(sizeof(DefaultAllocator::Page) == PAGE_SIZE);
 
+	struct SizeToBinTable {
+		constexpr SizeToBinTable() : bins() {
+			u32 bin = 0;
+			for (u32 i = 0; i < lengthOf(bins); ++i) {
+				while (SIZE_CLASSES[bin] < i * 8) ++bin;
+				bins[i] = u8(bin);
+			}
+		}
+		u8 bins[SMALL_ALLOC_MAX_SIZE / 8 + 1];
+	};
+
+	static constexpr SizeToBinTable SIZE_TO_BIN;
+
 	static u32 sizeToBin(size_t n) {
 		ASSERT(n > 0);
 		ASSERT(n <= SMALL_ALLOC_MAX_SIZE);
-		#ifdef _WIN32
-			unsigned long res;
-			return _BitScanReverse(&res, ((unsigned long)n - 1) >> 2) ? res : 0;
-		#else
-			return 31 - __builtin_clz((n - 1) >> 2);
-		#endif
+		return SIZE_TO_BIN.bins[(n + 7) >> 3];
+	}
+
+	// items are at multiples of item_size from page start, so this is the alignment they are guaranteed to have
+	static bool isBinAligned(u32 bin, size_t align) {
+		return (SIZE_CLASSES[bin] & (align - 1)) == 0;
 	}
 
 	void initPage(u32 item_size, DefaultAllocator::Page* page) {
-		os::memCommit(page, PAGE_SIZE);
 		page = new (NewPlaceholder(), page) DefaultAllocator::Page;
 		page->header.first_free = 0;
 		page->header.prev = nullptr;
 		page->header.next = nullptr;
 		page->header.item_size = item_size;
+		page->header.allocated_count = 0;
 
 		for (u32 i = 0; i < sizeof(page->data) / item_size; ++i) {
 			*(u32*)&page->data[i * item_size] = u32(i * item_size + item_size);
@@ -58,89 +79,258 @@ namespace Lumix
 		return (DefaultAllocator::Page*)((uintptr)ptr & ~u64(PAGE_SIZE - 1));
 	}
 
-	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+	static void unlinkPage(DefaultAllocator& allocator, u32 bin, DefaultAllocator::Page* p) {
+		if (allocator.m_free_lists[bin] == p) {
+			allocator.m_free_lists[bin] = p->header.next;
+		}
+		if (p->header.next) {
+			p->header.next->header.prev = p->header.prev;
+		}
+		if (p->header.prev) {
+			p->header.prev->header.next = p->header.next;
+		}
+		p->header.next = p->header.prev = nullptr;
+	}
+
+	// allocator.m_mutex must be locked
+	static void freeSmallLocked(DefaultAllocator& allocator, void* mem) {
 		u8* ptr = (u8*)mem;
 		DefaultAllocator::Page* page = getPage(ptr);
-		
-		MutexGuard guard(allocator.m_mutex);
+		const u32 bin = sizeToBin(page->header.item_size);
+
 		if (page->header.first_free + page->header.item_size > sizeof(page->data)) {
 			ASSERT(!page->header.next);
 			ASSERT(!page->header.prev);
-			const u32 bin = sizeToBin(page->header.item_size);
 			page->header.next = allocator.m_free_lists[bin];
+			if (page->header.next) page->header.next->header.prev = page;
 			allocator.m_free_lists[bin] = page;
 		}
 
 		*(u32*)ptr = page->header.first_free;
 		page->header.first_free = u32(ptr - page->data);
+		--page->header.allocated_count;
+
+		if (page->header.allocated_count == 0) {
+			if (allocator.m_empty_pages_count < MAX_EMPTY_PAGES) {
+				++allocator.m_empty_pages_count;
+				return;
+			}
+
+			// give it back to OS
+			unlinkPage(allocator, bin, page);
+			const u32 page_idx = u32(((u8*)page - allocator.m_small_allocations) / PAGE_SIZE);
+			const u32 free_pages_per_os_page = os::getMemPageSize() / sizeof(u32);
+			if (allocator.m_free_pages_count % free_pages_per_os_page == 0) {
+				os::memCommit(allocator.m_free_pages + allocator.m_free_pages_count, os::getMemPageSize());
+			}
+			allocator.m_free_pages[allocator.m_free_pages_count] = page_idx;
+			++allocator.m_free_pages_count;
+			os::memDecommit(page, PAGE_SIZE);
+		}
 	}
 
 	static void* reallocSmall(DefaultAllocator& allocator, void* mem, size_t n) {
 		DefaultAllocator::Page* p = getPage(mem);
+		if (n == 0) {
+			allocator.deallocate(mem);
+			return nullptr;
+		}
 		if (n <= SMALL_ALLOC_MAX_SIZE) {
 			const u32 bin = sizeToBin(n);
 			if (sizeToBin(p->header.item_size) == bin) return mem;
 		}
-		
+
 		void* new_mem = allocator.allocate(n);
 		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
 		allocator.deallocate(mem);
 		return new_mem;
 	}
-	
+
 	static void* reallocSmallAligned(DefaultAllocator& allocator, void* mem, size_t n, size_t align) {
 		DefaultAllocator::Page* p = getPage(mem);
+		if (n == 0) {
+			allocator.deallocate_aligned(mem);
+			return nullptr;
+		}
 		if (n <= SMALL_ALLOC_MAX_SIZE) {
 			const u32 bin = sizeToBin(n);
-			if (sizeToBin(p->header.item_size) == bin) return mem;
+			if (sizeToBin(p->header.item_size) == bin && isBinAligned(bin, align)) return mem;
 		}
-		
+
 		void* new_mem = allocator.allocate_aligned(n, align);
 		memcpy(new_mem, mem, minimum((size_t)p->header.item_size, n));
 		allocator.deallocate_aligned(mem);
 		return new_mem;
 	}
 
-	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
-		const u32 bin = sizeToBin(n);
-
-		MutexGuard guard(allocator.m_mutex);
-
+	// allocator.m_mutex must be locked
+	static void* allocSmallLocked(DefaultAllocator& allocator, u32 bin) {
 		if (!allocator.m_small_allocations) {
-			allocator.m_small_allocations = (u8*)os::memReserve(PAGE_SIZE * MAX_PAGE_COUNT);
+			// os page can be smaller than our page, align manually
+			allocator.m_reserved_mem = (u8*)os::memReserve(PAGE_SIZE * (MAX_PAGE_COUNT + 1));
+			if (!allocator.m_reserved_mem) return nullptr;
+			allocator.m_small_allocations = (u8*)(((uintptr)allocator.m_reserved_mem + PAGE_SIZE - 1) & ~uintptr(PAGE_SIZE - 1));
+			allocator.m_free_pages = (u32*)os::memReserve(MAX_PAGE_COUNT * sizeof(u32));
 		}
 		DefaultAllocator::Page* p = allocator.m_free_lists[bin];
 		if (!p) {
-			if (allocator.m_page_count == MAX_PAGE_COUNT) return nullptr;
-
-			p = (DefaultAllocator::Page*)(allocator.m_small_allocations + PAGE_SIZE * allocator.m_page_count);
-			initPage(8 << bin, p);
+			if (allocator.m_free_pages_count > 0) {
+				--allocator.m_free_pages_count;
+				const u32 page_idx = allocator.m_free_pages[allocator.m_free_pages_count];
+				p = (DefaultAllocator::Page*)(allocator.m_small_allocations + PAGE_SIZE * page_idx);
+				os::memCommit(p, PAGE_SIZE);
+			}
+			else {
+				if (allocator.m_page_count == MAX_PAGE_COUNT) return nullptr;
+				p = (DefaultAllocator::Page*)(allocator.m_small_allocations + PAGE_SIZE * allocator.m_page_count);
+				os::memCommit(p, PAGE_SIZE);
+				++allocator.m_page_count;
+			}
+			initPage(SIZE_CLASSES[bin], p);
 			allocator.m_free_lists[bin] = p;
-			++allocator.m_page_count;
+			++allocator.m_empty_pages_count;
 		}
 
 		ASSERT(p->header.item_size > 0);
-		ASSERT(p->header.first_free + n < sizeof(p->data));
+		ASSERT(p->header.first_free + p->header.item_size <= sizeof(p->data));
 		void* res = &p->data[p->header.first_free];
 		p->header.first_free = *(u32*)res;
+		if (p->header.allocated_count == 0) --allocator.m_empty_pages_count;
+		++p->header.allocated_count;
 
 		const bool is_page_full = p->header.first_free + p->header.item_size > sizeof(p->data);
-		if (is_page_full) {
-			if (allocator.m_free_lists[bin] == p) {
-				allocator.m_free_lists[bin] = p->header.next;
-			}
-			if (p->header.next) {
-				p->header.next->header.prev = p->header.prev;
+		if (is_page_full) unlinkPage(allocator, bin, p);
+
+		return res;
+	}
+
+	// free small blocks owned by a thread, so most small allocations and deallocations don't lock the allocator
+	// blocks are moved between the cache and the allocator in batches
+	struct DefaultAllocator::ThreadCache {
+		// number of blocks moved at once, big blocks are moved in smaller batches
+		static u32 getBatchSize(u32 bin) {
+			return clamp(8192 / SIZE_CLASSES[bin], 2u, 32u);
+		}
+
+		~ThreadCache();
+		void flush(u32 bin, u32 count);
+
+		struct Bin {
+			// linked list through the first bytes of the free blocks
+			void* head = nullptr;
+			u32 count = 0;
+		};
+
+		DefaultAllocator* allocator = nullptr;
+		Bin bins[BINS_COUNT];
+		ThreadCache* next = nullptr;
+		ThreadCache* prev = nullptr;
+	};
+
+	// protects ThreadCache::allocator, since both thread and allocator can go away first
+	static Mutex g_thread_caches_mutex;
+	// e.g. profiler has its own allocator, so there's usually more than one allocator used by a thread
+	static thread_local DefaultAllocator::ThreadCache g_thread_caches[4];
+
+	// allocator.m_mutex must be locked
+	void DefaultAllocator::ThreadCache::flush(u32 bin, u32 count) {
+		Bin& b = bins[bin];
+		for (u32 i = 0; i < count && b.head; ++i) {
+			void* mem = b.head;
+			b.head = *(void**)mem;
+			--b.count;
+			freeSmallLocked(*allocator, mem);
+		}
+	}
+
+	DefaultAllocator::ThreadCache::~ThreadCache() {
+		MutexGuard lock(g_thread_caches_mutex);
+		if (!allocator) return;
+
+		MutexGuard guard(allocator->m_mutex);
+		for (u32 i = 0; i < lengthOf(bins); ++i) {
+			flush(i, bins[i].count);
+		}
+		if (prev) prev->next = next;
+		else allocator->m_thread_caches = next;
+		if (next) next->prev = prev;
+		allocator = nullptr;
+	}
+
+	static DefaultAllocator::ThreadCache* getThreadCache(DefaultAllocator& allocator) {
+		DefaultAllocator::ThreadCache* caches = g_thread_caches;
+		for (u32 i = 0; i < lengthOf(g_thread_caches); ++i) {
+			if (caches[i].allocator == &allocator) return &caches[i];
+		}
+
+		DefaultAllocator::ThreadCache* free_cache = nullptr;
+		for (u32 i = 0; i < lengthOf(g_thread_caches); ++i) {
+			if (!caches[i].allocator) {
+				free_cache = &caches[i];
+				break;
 			}
-			if (p->header.prev) {
-				p->header.prev->header.next = p->header.next;
+		}
+		// no free slot, use the shared lists
+		if (!free_cache) return nullptr;
+
+		DefaultAllocator::ThreadCache& cache = *free_cache;
+		MutexGuard lock(g_thread_caches_mutex);
+		MutexGuard guard(allocator.m_mutex);
+		cache.allocator = &allocator;
+		cache.prev = nullptr;
+		cache.next = allocator.m_thread_caches;
+		if (cache.next) cache.next->prev = &cache;
+		allocator.m_thread_caches = &cache;
+		return &cache;
+	}
+
+	static void* allocSmall(DefaultAllocator& allocator, size_t n) {
+		const u32 bin = sizeToBin(n);
+		DefaultAllocator::ThreadCache* cache = getThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			return allocSmallLocked(allocator, bin);
+		}
+
+		DefaultAllocator::ThreadCache::Bin& b = cache->bins[bin];
+		if (!b.head) {
+			MutexGuard guard(allocator.m_mutex);
+			for (u32 i = 0, c = DefaultAllocator::ThreadCache::getBatchSize(bin); i < c; ++i) {
+				void* mem = allocSmallLocked(allocator, bin);
+				if (!mem) break;
+				*(void**)mem = b.head;
+				b.head = mem;
+				++b.count;
 			}
-			p->header.next = p->header.prev = nullptr;
+			if (!b.head) return nullptr;
 		}
 
+		void* res = b.head;
+		b.head = *(void**)res;
+		--b.count;
 		return res;
 	}
 
+	static void freeSmall(DefaultAllocator& allocator, void* mem) {
+		DefaultAllocator::ThreadCache* cache = getThreadCache(allocator);
+		if (!cache) {
+			MutexGuard guard(allocator.m_mutex);
+			freeSmallLocked(allocator, mem);
+			return;
+		}
+
+		const u32 bin = sizeToBin(getPage(mem)->header.item_size);
+		DefaultAllocator::ThreadCache::Bin& b = cache->bins[bin];
+		*(void**)mem = b.head;
+		b.head = mem;
+		++b.count;
+		const u32 batch_size = DefaultAllocator::ThreadCache::getBatchSize(bin);
+		if (b.count >= batch_size * 2) {
+			MutexGuard guard(allocator.m_mutex);
+			cache->flush(bin, batch_size);
+		}
+	}
+
 	static bool isSmallAlloc(DefaultAllocator& allocator, void* p) {
 		return allocator.m_small_allocations && p >= allocator.m_small_allocations && p < allocator.m_small_allocations + (PAGE_SIZE * MAX_PAGE_COUNT);
 	}
@@ -151,7 +341,18 @@ namespace Lumix
 	}
 
 	DefaultAllocator::~DefaultAllocator() {
-		os::memRelease(m_small_allocations);
+		{
+			// cached blocks are released with the rest of memory
+			MutexGuard lock(g_thread_caches_mutex);
+			for (ThreadCache* cache = m_thread_caches; cache; cache = cache->next) {
+				cache->allocator = nullptr;
+				for (ThreadCache::Bin& bin : cache->bins) bin = {};
+			}
+		}
+		if (m_reserved_mem) {
+			os::memRelease(m_reserved_mem, PAGE_SIZE * (MAX_PAGE_COUNT + 1));
+			os::memRelease(m_free_pages, MAX_PAGE_COUNT * sizeof(u32));
+		}
 	}
 
 	void* DefaultAllocator::allocate(size_t n)
@@ -184,7 +385,7 @@ namespace Lumix
 #ifdef _WIN32
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
-		if (size <= SMALL_ALLOC_MAX_SIZE && align <= size) {
+		if (size <= SMALL_ALLOC_MAX_SIZE && isBinAligned(sizeToBin(size), align)) {
 			return allocSmall(*this, size);
 		}
 		return _aligned_malloc(size, align);
@@ -211,18 +412,28 @@ namespace Lumix
 #else
 	void* DefaultAllocator::allocate_aligned(size_t size, size_t align)
 	{
+		if (size <= SMALL_ALLOC_MAX_SIZE && isBinAligned(sizeToBin(size), align)) {
+			return allocSmall(*this, size);
+		}
 		return aligned_alloc(align, size);
 	}
 
 
 	void DefaultAllocator::deallocate_aligned(void* ptr)
 	{
+		if (isSmallAlloc(*this, ptr)) {
+			freeSmall(*this, ptr);
+			return;
+		}
 		free(ptr);
 	}
 
 
 	void* DefaultAllocator::reallocate_aligned(void* ptr, size_t size, size_t align)
 	{
+		if (isSmallAlloc(*this, ptr)) {
+			return reallocSmallAligned(*this, ptr, size, align);
+		}
 		// POSIX and glibc do not provide a way to realloc with alignment preservation
 		if (size == 0) {
 			free(ptr);
@@ -232,8 +443,10 @@ namespace Lumix
 		if (newptr == nullptr) {
 			return nullptr;
 		}
-		memcpy(newptr, ptr, malloc_usable_size(ptr));
-		free(ptr);
+		if (ptr) {
+			memcpy(newptr, ptr, minimum(size, malloc_usable_size(ptr)));
+			free(ptr);
+		}
 		return newptr;
 	}
 #endif
@@ -296,4 +509,365 @@ void* BaseProxyAllocator::reallocate(void* ptr, size_t size)
 }
 
 
+
+// threads take chunks from the current buffer and bump allocate from them
+static constexpr u32 FRAME_CHUNK_SIZE = 64 * 1024;
+static constexpr u32 FRAME_COMMIT_STEP = 256 * 1024;
+
+struct FrameArena {
+	u32 allocator_id = 0;
+	u32 frame = 0;
+	u8* cur = nullptr;
+	u8* end = nullptr;
+};
+
+// each allocation is preceded by its size, so it can be reallocated
+struct FrameAllocHeader {
+	u32 size;
+	u32 padding;
+};
+
+static volatile i32 g_frame_allocator_id = 0;
+static thread_local FrameArena g_frame_arenas[4];
+
+static FrameArena& getFrameArena(u32 allocator_id, u32 frame) {
+	FrameArena* arena = nullptr;
+	for (FrameArena& a : g_frame_arenas) {
+		if (a.allocator_id == allocator_id) {
+			arena = &a;
+			break;
+		}
+		if (!arena && a.allocator_id == 0) arena = &a;
+	}
+	// all slots taken by other allocators, steal one, remaining space in it is wasted
+	if (!arena) arena = &g_frame_arenas[allocator_id % lengthOf(g_frame_arenas)];
+	if (arena->allocator_id != allocator_id || arena->frame != frame) {
+		arena->allocator_id = allocator_id;
+		arena->frame = frame;
+		arena->cur = nullptr;
+		arena->end = nullptr;
+	}
+	return *arena;
+}
+
+static u8* alignPtr(u8* ptr, size_t align) {
+	return (u8*)(((uintptr)ptr + align - 1) & ~(uintptr)(align - 1));
+}
+
+FrameAllocator::FrameAllocator(IAllocator& fallback, u32 buffers_count, u32 buffer_size)
+	: m_fallback(fallback)
+	, m_buffers_count(buffers_count)
+	, m_buffer_size(buffer_size)
+{
+	ASSERT(buffers_count > 0 && buffers_count <= MAX_BUFFERS);
+	ASSERT(buffer_size % FRAME_COMMIT_STEP == 0 && buffer_size < 0x7fffFFFF);
+	m_id = atomicIncrement(&g_frame_allocator_id);
+	m_reserved_mem = (u8*)os::memReserve(size_t(buffer_size) * buffers_count);
+	for (u32 i = 0; i < buffers_count; ++i) {
+		m_buffers[i].mem = m_reserved_mem + size_t(buffer_size) * i;
+		m_buffers[i].used = 0;
+		m_buffers[i].committed = 0;
+	}
+}
+
+FrameAllocator::~FrameAllocator() {
+	os::memRelease(m_reserved_mem, size_t(m_buffer_size) * m_buffers_count);
+}
+
+void FrameAllocator::endFrame() {
+	Buffer& prev = m_buffers[m_frame % m_buffers_count];
+	m_high_water_mark = maximum(m_high_water_mark, (u32)prev.used);
+	++m_frame;
+	m_buffers[m_frame % m_buffers_count].used = 0;
+}
+
+bool FrameAllocator::isFrameMemory(const void* ptr) const {
+	return ptr >= m_reserved_mem && ptr < m_reserved_mem + size_t(m_buffer_size) * m_buffers_count;
+}
+
+void FrameAllocator::commit(Buffer& buffer, u32 end) {
+	// committed memory is kept, so steady state frames do not call the OS
+	if (end <= (u32)buffer.committed) return;
+	MutexGuard lock(m_mutex);
+	if (end <= (u32)buffer.committed) return;
+	const u32 new_committed = minimum((end + FRAME_COMMIT_STEP - 1) & ~(FRAME_COMMIT_STEP - 1), m_buffer_size);
+	os::memCommit(buffer.mem + buffer.committed, new_committed - buffer.committed);
+	memoryBarrier();
+	buffer.committed = new_committed;
+}
+
+u8* FrameAllocator::allocChunk(u32 size) {
+	Buffer& buffer = m_buffers[m_frame % m_buffers_count];
+	for (;;) {
+		const i32 used = buffer.used;
+		if (u64(used) + size > m_buffer_size) return nullptr;
+		if (compareAndExchange(&buffer.used, used + size, used)) {
+			commit(buffer, used + size);
+			return buffer.mem + used;
+		}
+	}
+}
+
+void* FrameAllocator::allocate_aligned(size_t size, size_t align) {
+	align = maximum(align, sizeof(FrameAllocHeader));
+	const size_t needed = size + align + sizeof(FrameAllocHeader);
+	FrameArena& arena = getFrameArena(m_id, m_frame);
+	u8* ptr = arena.cur ? alignPtr(arena.cur + sizeof(FrameAllocHeader), align) : nullptr;
+	if (!ptr || ptr + size > arena.end) {
+		if (needed > FRAME_CHUNK_SIZE / 4) {
+			// big allocations get their own chunk, so the arena is not wasted
+			u8* mem = needed < m_buffer_size ? allocChunk(u32(needed)) : nullptr;
+			if (!mem) return m_fallback.allocate_aligned(size, align);
+			ptr = alignPtr(mem + sizeof(FrameAllocHeader), align);
+		}
+		else {
+			u8* chunk = allocChunk(FRAME_CHUNK_SIZE);
+			if (!chunk) return m_fallback.allocate_aligned(size, align);
+			arena.end = chunk + FRAME_CHUNK_SIZE;
+			ptr = alignPtr(chunk + sizeof(FrameAllocHeader), align);
+			arena.cur = ptr + size;
+		}
+	}
+	else {
+		arena.cur = ptr + size;
+	}
+	((FrameAllocHeader*)ptr)[-1].size = u32(size);
+	return ptr;
+}
+
+void FrameAllocator::deallocate_aligned(void* ptr) {
+	if (ptr && !isFrameMemory(ptr)) m_fallback.deallocate_aligned(ptr);
+}
+
+void* FrameAllocator::reallocate_aligned(void* ptr, size_t size, size_t align) {
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+	if (!isFrameMemory(ptr)) return m_fallback.reallocate_aligned(ptr, size, align);
+
+	FrameAllocHeader& header = ((FrameAllocHeader*)ptr)[-1];
+	if (size <= header.size) {
+		header.size = u32(size);
+		return ptr;
+	}
+
+	// grow in place if it's the last allocation in this thread's arena
+	FrameArena& arena = getFrameArena(m_id, m_frame);
+	if ((u8*)ptr + header.size == arena.cur && (u8*)ptr + size <= arena.end) {
+		arena.cur = (u8*)ptr + size;
+		header.size = u32(size);
+		return ptr;
+	}
+
+	void* new_ptr = allocate_aligned(size, align);
+	memcpy(new_ptr, ptr, header.size);
+	return new_ptr;
+}
+
+void* FrameAllocator::allocate(size_t size) {
+	return allocate_aligned(size, 16);
+}
+
+void FrameAllocator::deallocate(void* ptr) {
+	deallocate_aligned(ptr);
+}
+
+void* FrameAllocator::reallocate(void* ptr, size_t size) {
+	return reallocate_aligned(ptr, size, 16);
+}
+
+
+
+// precedes every allocation made through TagAllocator
+struct TagAllocationHeader {
+	TagAllocator* tag;
+	u64 size : 48;
+	// distance from the pointer returned by parent
+	u64 offset : 16;
+};
+
+static_assert(sizeof(TagAllocationHeader) == 16);
+
+static TagAllocationHeader& getTagHeader(void* ptr) {
+	return ((TagAllocationHeader*)ptr)[-1];
+}
+
+struct TagAllocator::Capture {
+	explicit Capture(IAllocator& allocator) : live(allocator) {}
+
+	Mutex mutex;
+	debug::StackTree stack_tree;
+	// user pointer -> leaf of its callstack
+	HashMap<void*, debug::StackNode*> live;
+};
+
+static Mutex g_tags_mutex;
+static TagAllocator* g_first_tag = nullptr;
+
+TagAllocator::TagAllocator(IAllocator& parent, const char* tag_name)
+	: m_parent(parent)
+	, m_tag_name(tag_name)
+{
+	MutexGuard lock(g_tags_mutex);
+	m_next = g_first_tag;
+	if (g_first_tag) g_first_tag->m_prev = this;
+	g_first_tag = this;
+}
+
+TagAllocator::~TagAllocator() {
+	{
+		MutexGuard lock(g_tags_mutex);
+		if (m_prev) m_prev->m_next = m_next;
+		else g_first_tag = m_next;
+		if (m_next) m_next->m_prev = m_prev;
+	}
+	LUMIX_DELETE(m_parent, m_capture);
+}
+
+TagAllocator* TagAllocator::getFirst() {
+	return g_first_tag;
+}
+
+void TagAllocator::endFrame() {
+	MutexGuard lock(g_tags_mutex);
+	for (TagAllocator* tag = g_first_tag; tag; tag = tag->m_next) {
+		// subtract instead of zeroing, so allocations from other threads are not lost
+		const i32 count = tag->m_frame_allocations_count;
+		const i64 size = tag->m_frame_allocated_size;
+		atomicSubtract(&tag->m_frame_allocations_count, count);
+		atomicAdd(&tag->m_frame_allocated_size, -size);
+		tag->m_last_frame_allocations_count = count;
+		tag->m_last_frame_allocated_size = size;
+	}
+}
+
+void TagAllocator::enableCallstackCapture(bool enable) {
+	if (!m_capture) m_capture = LUMIX_NEW(m_parent, Capture)(m_parent);
+	MutexGuard lock(m_capture->mutex);
+	m_is_capture_enabled = enable;
+	if (!enable) m_capture->live.clear();
+}
+
+u32 TagAllocator::getLiveCallstacks(Span<LiveCallstack> out) {
+	if (!m_capture) return 0;
+
+	Array<LiveCallstack> callstacks(m_parent);
+	{
+		HashMap<debug::StackNode*, u32> map(m_parent);
+		MutexGuard lock(m_capture->mutex);
+		for (auto iter = m_capture->live.begin(), end = m_capture->live.end(); iter != end; ++iter) {
+			const u64 size = getTagHeader(iter.key()).size;
+			auto map_iter = map.find(iter.value());
+			if (map_iter.isValid()) {
+				LiveCallstack& cs = callstacks[map_iter.value()];
+				++cs.count;
+				cs.size += size;
+			}
+			else {
+				map.insert(iter.value(), callstacks.size());
+				callstacks.push({iter.value(), 1, size});
+			}
+		}
+	}
+
+	qsort(callstacks.begin(), callstacks.size(), sizeof(LiveCallstack), [](const void* a, const void* b) -> int {
+		const u64 sa = ((const LiveCallstack*)a)->size;
+		const u64 sb = ((const LiveCallstack*)b)->size;
+		return sa > sb ? -1 : (sa < sb ? 1 : 0);
+	});
+	const u32 count = minimum(out.length(), (u32)callstacks.size());
+	if (count > 0) memcpy(out.begin(), callstacks.begin(), count * sizeof(LiveCallstack));
+	return callstacks.size();
+}
+
+void* TagAllocator::onAllocated(void* system_ptr, size_t size, u32 offset) {
+	if (!system_ptr) return nullptr;
+
+	void* ptr = (u8*)system_ptr + offset;
+	TagAllocationHeader& header = getTagHeader(ptr);
+	header.tag = this;
+	header.size = size;
+	header.offset = offset;
+
+	const i64 current = atomicAdd(&m_current_size, (i64)size) + (i64)size;
+	for (;;) {
+		const i64 peak = m_peak_size;
+		if (current <= peak || compareAndExchange64(&m_peak_size, current, peak)) break;
+	}
+	atomicIncrement(&m_live_count);
+	atomicIncrement(&m_frame_allocations_count);
+	atomicAdd(&m_frame_allocated_size, (i64)size);
+
+	if (m_is_capture_enabled) {
+		MutexGuard lock(m_capture->mutex);
+		if (m_is_capture_enabled) m_capture->live.insert(ptr, m_capture->stack_tree.record());
+	}
+	return ptr;
+}
+
+void TagAllocator::onFree(void* ptr, size_t size) {
+	atomicAdd(&m_current_size, -(i64)size);
+	atomicDecrement(&m_live_count);
+
+	if (m_is_capture_enabled) {
+		MutexGuard lock(m_capture->mutex);
+		auto iter = m_capture->live.find(ptr);
+		if (iter.isValid()) m_capture->live.erase(iter);
+	}
+}
+
+void* TagAllocator::allocate(size_t size) {
+	const u32 offset = sizeof(TagAllocationHeader);
+	return onAllocated(m_parent.allocate(size + offset), size, offset);
+}
+
+void TagAllocator::deallocate(void* ptr) {
+	if (!ptr) return;
+	const TagAllocationHeader header = getTagHeader(ptr);
+	ASSERT(header.tag == this);
+	onFree(ptr, header.size);
+	m_parent.deallocate((u8*)ptr - header.offset);
+}
+
+void* TagAllocator::reallocate(void* ptr, size_t size) {
+	if (!ptr) return allocate(size);
+	if (size == 0) {
+		deallocate(ptr);
+		return nullptr;
+	}
+	const TagAllocationHeader header = getTagHeader(ptr);
+	ASSERT(header.tag == this);
+	onFree(ptr, header.size);
+	return onAllocated(m_parent.reallocate((u8*)ptr - header.offset, size + header.offset), size, header.offset);
+}
+
+void* TagAllocator::allocate_aligned(size_t size, size_t align) {
+	const u32 offset = (u32)maximum(align, sizeof(TagAllocationHeader));
+	return onAllocated(m_parent.allocate_aligned(size + offset, align), size, offset);
+}
+
+void TagAllocator::deallocate_aligned(void* ptr) {
+	if (!ptr) return;
+	const TagAllocationHeader header = getTagHeader(ptr);
+	ASSERT(header.tag == this);
+	onFree(ptr, header.size);
+	m_parent.deallocate_aligned((u8*)ptr - header.offset);
+}
+
+void* TagAllocator::reallocate_aligned(void* ptr, size_t size, size_t align) {
+	if (!ptr) return allocate_aligned(size, align);
+	if (size == 0) {
+		deallocate_aligned(ptr);
+		return nullptr;
+	}
+	const TagAllocationHeader header = getTagHeader(ptr);
+	ASSERT(header.tag == this);
+	ASSERT(header.offset == maximum(align, sizeof(TagAllocationHeader)));
+	onFree(ptr, header.size);
+	return onAllocated(m_parent.reallocate_aligned((u8*)ptr - header.offset, size + header.offset, align), size, header.offset);
+}
+
+
 } // namespace Lumix
@@ -5,8 +5,12 @@
 
 namespace Lumix {
 
+namespace debug { struct StackNode; }
+
 struct LUMIX_ENGINE_API DefaultAllocator final : IAllocator {
 	struct Page;
+	struct ThreadCache;
+	enum { BINS_COUNT = 17 };
 
 	DefaultAllocator();
 	~DefaultAllocator();
@@ -18,9 +22,16 @@ struct LUMIX_ENGINE_API DefaultAllocator final : IAllocator {
 	void deallocate_aligned(void* ptr) override;
 	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
 
+	u8* m_reserved_mem = nullptr;
 	u8* m_small_allocations = nullptr;
-	Page* m_free_lists[4];
+	Page* m_free_lists[BINS_COUNT];
 	u32 m_page_count = 0;
+	// empty pages still in m_free_lists
+	u32 m_empty_pages_count = 0;
+	// indices of decommitted pages, can be reused by any bin
+	u32* m_free_pages = nullptr;
+	u32 m_free_pages_count = 0;
+	ThreadCache* m_thread_caches = nullptr;
 	Mutex m_mutex;
 };
 
@@ -42,4 +53,110 @@ private:
 	volatile i32 m_allocation_count;
 };
 
-}
\ No newline at end of file
+// linear per-thread arenas, everything allocated is freed at once in endFrame
+// memory lives for `buffers_count` frames, so with more buffers it can be consumed later, e.g. by render thread
+// deallocate is a noop unless the allocation did not fit and was served by fallback allocator
+// endFrame must not run concurrently with any allocation
+struct LUMIX_ENGINE_API FrameAllocator final : IAllocator {
+	FrameAllocator(IAllocator& fallback, u32 buffers_count, u32 buffer_size);
+	~FrameAllocator();
+
+	void endFrame();
+	// peak bytes used by a single buffer in any finished frame
+	u32 getHighWaterMark() const { return m_high_water_mark; }
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+private:
+	struct Buffer {
+		u8* mem;
+		volatile i32 used;
+		volatile i32 committed;
+	};
+	enum { MAX_BUFFERS = 4 };
+
+	bool isFrameMemory(const void* ptr) const;
+	u8* allocChunk(u32 size);
+	void commit(Buffer& buffer, u32 end);
+
+	IAllocator& m_fallback;
+	Buffer m_buffers[MAX_BUFFERS];
+	u32 m_buffers_count;
+	u32 m_buffer_size;
+	u8* m_reserved_mem;
+	u32 m_id;
+	u32 m_frame = 0;
+	u32 m_high_water_mark = 0;
+	Mutex m_mutex;
+};
+
+// forwards to parent allocator and accounts memory to a named tag, e.g. "renderer"
+// all tags can be enumerated with getFirst/getNext, so tools and automated runs can check memory usage
+// memory must be freed through the same tag allocator it was allocated from
+struct LUMIX_ENGINE_API TagAllocator final : IAllocator {
+	struct LiveCallstack {
+		debug::StackNode* stack;
+		u32 count;
+		u64 size;
+	};
+
+	// name must be a literal or outlive the allocator
+	TagAllocator(IAllocator& parent, const char* tag_name);
+	~TagAllocator();
+
+	// tags must not be created or destroyed while iterating
+	static TagAllocator* getFirst();
+	TagAllocator* getNext() const { return m_next; }
+	// updates per frame stats of all tags
+	static void endFrame();
+
+	void* allocate(size_t size) override;
+	void deallocate(void* ptr) override;
+	void* reallocate(void* ptr, size_t size) override;
+	void* allocate_aligned(size_t size, size_t align) override;
+	void deallocate_aligned(void* ptr) override;
+	void* reallocate_aligned(void* ptr, size_t size, size_t align) override;
+
+	const char* getName() const { return m_tag_name; }
+	IAllocator& getParent() { return m_parent; }
+	i64 getCurrentSize() const { return m_current_size; }
+	i64 getPeakSize() const { return m_peak_size; }
+	i32 getLiveCount() const { return m_live_count; }
+	// allocations and reallocations in the last finished frame
+	i32 getFrameAllocationsCount() const { return m_last_frame_allocations_count; }
+	i64 getFrameAllocatedSize() const { return m_last_frame_allocated_size; }
+
+	// records callstack of every allocation, slow, meant for leak hunting
+	void enableCallstackCapture(bool enable);
+	bool isCallstackCaptureEnabled() const { return m_is_capture_enabled; }
+	// live allocations made while capture was enabled, grouped by callstack, biggest first
+	// returns the number of callstacks, which can be more than out.length()
+	u32 getLiveCallstacks(Span<LiveCallstack> out);
+
+private:
+	struct Capture;
+
+	void* onAllocated(void* system_ptr, size_t size, u32 offset);
+	void onFree(void* ptr, size_t size);
+
+	IAllocator& m_parent;
+	const char* m_tag_name;
+	TagAllocator* m_next = nullptr;
+	TagAllocator* m_prev = nullptr;
+	volatile i64 m_current_size = 0;
+	volatile i64 m_peak_size = 0;
+	volatile i32 m_live_count = 0;
+	volatile i32 m_frame_allocations_count = 0;
+	volatile i64 m_frame_allocated_size = 0;
+	i32 m_last_frame_allocations_count = 0;
+	i64 m_last_frame_allocated_size = 0;
+	Capture* m_capture = nullptr;
+	volatile bool m_is_capture_enabled = false;
+};
+
+}
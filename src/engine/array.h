@@ -5,31 +5,11 @@
 
 namespace Lumix {
 
-template <typename T> struct Array {
-	explicit Array(IAllocator& allocator)
-		: m_allocator(allocator)
-	{
-		m_data = nullptr;
-		m_capacity = 0;
-		m_size = 0;
-	}
-
-	Array(const Array& rhs) = delete;
-	void operator=(const Array& rhs) = delete;
-
-
-	Array(Array&& rhs)
-		: m_allocator(rhs.m_allocator)
-	{
-		m_data = nullptr;
-		m_capacity = 0;
-		m_size = 0;
-		
-		swap(rhs);
-	}
-
-
-	Array<T>&& move() { return static_cast<Array<T>&&>(*this); }
+// element management shared by Array and SmallArray
+// Derived::isInline() tells whether m_data is storage which must not be reallocated or freed
+template <typename T, typename Derived> struct ArrayBase {
+	ArrayBase(const ArrayBase& rhs) = delete;
+	void operator=(const ArrayBase& rhs) = delete;
 
 
 	T* begin() const { return m_data; }
@@ -42,24 +22,6 @@ template <typename T> struct Array {
 	operator Span<const T>() const { return Span(begin(), end()); }
 
 
-	void swap(Array<T>& rhs)
-	{
-		ASSERT(&rhs.m_allocator == &m_allocator);
-
-		u32 i = rhs.m_capacity;
-		rhs.m_capacity = m_capacity;
-		m_capacity = i;
-
-		i = m_size;
-		m_size = rhs.m_size;
-		rhs.m_size = i;
-
-		T* p = rhs.m_data;
-		rhs.m_data = m_data;
-		m_data = p;
-	}
-
-
 	template <typename Comparator>
 	void removeDuplicates(Comparator equals)
 	{
@@ -94,53 +56,6 @@ template <typename T> struct Array {
 		}
 	}
 
-
-	Array<T> makeCopy() const {
-		Array<T> res(m_allocator);
-		if (m_size == 0) return res;
-
-		res.m_data = (T*)m_allocator.allocate_aligned(m_size * sizeof(T), alignof(T));
-		res.m_capacity = m_size;
-		res.m_size = m_size;
-		for (u32 i = 0; i < m_size; ++i) {
-			new (NewPlaceholder(), res.m_data + i) T(m_data[i]);
-		}
-		return res;
-	}
-
-
-	void operator=(Array&& rhs)
-	{
-		ASSERT(&m_allocator == &rhs.m_allocator);
-		if (this != &rhs)
-		{
-			callDestructors(m_data, m_data + m_size);
-			m_allocator.deallocate_aligned(m_data);
-			m_data = rhs.m_data;
-			m_capacity = rhs.m_capacity;
-			m_size = rhs.m_size;
-			rhs.m_data = nullptr;
-			rhs.m_capacity = 0;
-			rhs.m_size = 0;
-		}
-	}
-
-
-	void free()
-	{
-		clear();
-		m_allocator.deallocate_aligned(m_data);
-		m_capacity = 0;
-		m_data = nullptr;
-	}
-
-
-	~Array()
-	{
-		callDestructors(m_data, m_data + m_size);
-		m_allocator.deallocate_aligned(m_data);
-	}
-
 	template <typename F>
 	int find(F predicate) const
 	{
@@ -205,23 +120,23 @@ template <typename T> struct Array {
 
 	void swapAndPop(u32 index)
 	{
-		if (index >= 0 && index < m_size)
+		if (index >= m_size) return;
+		if (index != m_size - 1)
 		{
-			if (index != m_size - 1)
-			{
-				if constexpr (__is_trivially_copyable(T)) {
-					memmove(m_data + index, m_data + m_size - 1, sizeof(T));
-				}
-				else {
-					m_data[index].~T();
-					if (index != m_size - 1) {
-						new (NewPlaceholder(), m_data + index) T(static_cast<T&&>(m_data[m_size - 1]));
-						m_data[m_size - 1].~T();
-					}
-				}
+			if constexpr (__is_trivially_copyable(T)) {
+				memmove(m_data + index, m_data + m_size - 1, sizeof(T));
 			}
-			--m_size;
+			else {
+				m_data[index].~T();
+				new (NewPlaceholder(), m_data + index) T(static_cast<T&&>(m_data[m_size - 1]));
+				m_data[m_size - 1].~T();
+			}
+		}
+		else
+		{
+			m_data[index].~T();
 		}
+		--m_size;
 	}
 
 	void eraseItem(const T& item)
@@ -245,19 +160,19 @@ template <typename T> struct Array {
 			if (index < m_size - 1)
 			{
 				if constexpr (__is_trivially_copyable(T)) {
-					memcpy(m_data + index, m_data + index + 1, sizeof(T) * (m_size - index - 1));
+					memmove(m_data + index, m_data + index + 1, sizeof(T) * (m_size - index - 1));
 				}
 				else {
 					for (u32 i = index; i < m_size - 1; ++i) {
 						new (NewPlaceholder(), &m_data[i]) T(static_cast<T&&>(m_data[i + 1]));
 						m_data[i + 1].~T();
-					} 
+					}
 				}
 			}
 			--m_size;
 		}
 	}
-	
+
 	void push(T&& value)
 	{
 		u32 size = m_size;
@@ -309,11 +224,13 @@ template <typename T> struct Array {
 		else {
 			if (m_size == m_capacity) {
 				u32 new_capacity = m_capacity == 0 ? 4 : m_capacity * 2;
-				T* old_data = m_data; 
+				T* old_data = m_data;
+				const bool was_inline = isInline();
 				m_data = (T*)m_allocator.allocate_aligned(new_capacity * sizeof(T), alignof(T));
 				moveRange(m_data, old_data, idx);
 				moveRange(m_data + idx + 1, old_data + idx, m_size - idx);
-				m_allocator.deallocate_aligned(old_data);
+				if (!was_inline) m_allocator.deallocate_aligned(old_data);
+				m_capacity = new_capacity;
 			}
 			else {
 				moveRange(m_data + idx + 1, m_data + idx, m_size - idx);
@@ -368,20 +285,7 @@ template <typename T> struct Array {
 
 	void reserve(u32 capacity)
 	{
-		if (capacity > m_capacity)
-		{
-			if (__is_trivially_copyable(T)) {
-				m_data = (T*)m_allocator.reallocate_aligned(m_data, capacity * sizeof(T), alignof(T));
-			}
-			else {
-				T* new_data = (T*)m_allocator.allocate_aligned(capacity * sizeof(T), alignof(T));
-				moveRange(new_data, m_data, m_size);
-				callDestructors(m_data, m_data + m_size);
-				m_allocator.deallocate_aligned(m_data);
-				m_data = new_data;
-			}
-			m_capacity = capacity;
-		}
+		if (capacity > m_capacity) grow(capacity);
 	}
 
 	const T& operator[](u32 index) const
@@ -398,9 +302,9 @@ template <typename T> struct Array {
 
 	u32 byte_size() const { return m_size * sizeof(T); }
 	int size() const { return m_size; }
-	
+
 	// can be used instead of resize when resize won't compile because of unsuitable constructor
-	void shrink(u32 new_size) { 
+	void shrink(u32 new_size) {
 		ASSERT(new_size <= m_size);
 		for (u32 i = new_size; i < m_size; ++i) {
 			m_data[i].~T();
@@ -410,17 +314,31 @@ template <typename T> struct Array {
 
 	u32 capacity() const { return m_capacity; }
 
-private:
+protected:
+	ArrayBase(IAllocator& allocator, T* data, u32 capacity)
+		: m_allocator(allocator)
+	{
+		m_data = data;
+		m_capacity = capacity;
+		m_size = 0;
+	}
+
+	bool isInline() const { return static_cast<const Derived*>(this)->isInline(); }
+
 	void grow()
 	{
-		u32 new_capacity = m_capacity == 0 ? 4 : m_capacity * 2;
-		if constexpr (__is_trivially_copyable(T)) {
+		grow(m_capacity == 0 ? 4 : m_capacity * 2);
+	}
+
+	void grow(u32 new_capacity)
+	{
+		if (__is_trivially_copyable(T) && !isInline()) {
 			m_data = (T*)m_allocator.reallocate_aligned(m_data, new_capacity * sizeof(T), alignof(T));
 		}
 		else {
 			T* new_data = (T*)m_allocator.allocate_aligned(new_capacity * sizeof(T), alignof(T));
 			moveRange(new_data, m_data, m_size);
-			m_allocator.deallocate_aligned(m_data);
+			if (!isInline()) m_allocator.deallocate_aligned(m_data);
 			m_data = new_data;
 		}
 		m_capacity = new_capacity;
@@ -440,4 +358,192 @@ private:
 	T* m_data;
 };
 
+template <typename T> struct Array : ArrayBase<T, Array<T>> {
+	friend struct ArrayBase<T, Array<T>>;
+	using Base = ArrayBase<T, Array<T>>;
+	using Base::m_allocator;
+	using Base::m_capacity;
+	using Base::m_size;
+	using Base::m_data;
+
+	explicit Array(IAllocator& allocator)
+		: Base(allocator, nullptr, 0)
+	{
+	}
+
+	Array(const Array& rhs) = delete;
+	void operator=(const Array& rhs) = delete;
+
+
+	Array(Array&& rhs)
+		: Base(rhs.m_allocator, nullptr, 0)
+	{
+		swap(rhs);
+	}
+
+
+	Array<T>&& move() { return static_cast<Array<T>&&>(*this); }
+
+
+	void swap(Array<T>& rhs)
+	{
+		ASSERT(&rhs.m_allocator == &m_allocator);
+
+		u32 i = rhs.m_capacity;
+		rhs.m_capacity = m_capacity;
+		m_capacity = i;
+
+		i = m_size;
+		m_size = rhs.m_size;
+		rhs.m_size = i;
+
+		T* p = rhs.m_data;
+		rhs.m_data = m_data;
+		m_data = p;
+	}
+
+
+	Array<T> makeCopy() const {
+		Array<T> res(m_allocator);
+		if (m_size == 0) return res;
+
+		res.m_data = (T*)m_allocator.allocate_aligned(m_size * sizeof(T), alignof(T));
+		res.m_capacity = m_size;
+		res.m_size = m_size;
+		for (u32 i = 0; i < m_size; ++i) {
+			new (NewPlaceholder(), res.m_data + i) T(m_data[i]);
+		}
+		return res;
+	}
+
+
+	void operator=(Array&& rhs)
+	{
+		ASSERT(&m_allocator == &rhs.m_allocator);
+		if (this != &rhs)
+		{
+			this->callDestructors(m_data, m_data + m_size);
+			m_allocator.deallocate_aligned(m_data);
+			m_data = rhs.m_data;
+			m_capacity = rhs.m_capacity;
+			m_size = rhs.m_size;
+			rhs.m_data = nullptr;
+			rhs.m_capacity = 0;
+			rhs.m_size = 0;
+		}
+	}
+
+
+	void free()
+	{
+		this->clear();
+		m_allocator.deallocate_aligned(m_data);
+		m_capacity = 0;
+		m_data = nullptr;
+	}
+
+
+	~Array()
+	{
+		this->callDestructors(m_data, m_data + m_size);
+		m_allocator.deallocate_aligned(m_data);
+	}
+
+private:
+	static constexpr bool isInline() { return false; }
+};
+
+// same interface as Array, but first N elements are stored inline and do not allocate
+template <typename T, u32 N> struct SmallArray : ArrayBase<T, SmallArray<T, N>> {
+	friend struct ArrayBase<T, SmallArray<T, N>>;
+	using Base = ArrayBase<T, SmallArray<T, N>>;
+	using Base::m_allocator;
+	using Base::m_capacity;
+	using Base::m_size;
+	using Base::m_data;
+
+	explicit SmallArray(IAllocator& allocator)
+		: Base(allocator, (T*)m_inline, N)
+	{
+	}
+
+	SmallArray(const SmallArray& rhs) = delete;
+	void operator=(const SmallArray& rhs) = delete;
+
+	SmallArray(SmallArray&& rhs)
+		: Base(rhs.m_allocator, (T*)m_inline, N)
+	{
+		steal(rhs);
+	}
+
+	void operator=(SmallArray&& rhs)
+	{
+		ASSERT(&m_allocator == &rhs.m_allocator);
+		if (this != &rhs) {
+			free();
+			steal(rhs);
+		}
+	}
+
+	~SmallArray()
+	{
+		this->callDestructors(m_data, m_data + m_size);
+		if (!isInline()) m_allocator.deallocate_aligned(m_data);
+	}
+
+	SmallArray<T, N>&& move() { return static_cast<SmallArray<T, N>&&>(*this); }
+
+	void swap(SmallArray<T, N>& rhs)
+	{
+		ASSERT(&rhs.m_allocator == &m_allocator);
+		SmallArray<T, N> tmp(static_cast<SmallArray<T, N>&&>(rhs));
+		rhs.steal(*this);
+		steal(tmp);
+	}
+
+	SmallArray<T, N> makeCopy() const {
+		SmallArray<T, N> res(m_allocator);
+		res.reserve(m_size);
+		for (u32 i = 0; i < m_size; ++i) {
+			new (NewPlaceholder(), res.m_data + i) T(m_data[i]);
+		}
+		res.m_size = m_size;
+		return res;
+	}
+
+	// releases heap memory, if any
+	void free()
+	{
+		this->clear();
+		if (!isInline()) m_allocator.deallocate_aligned(m_data);
+		m_data = inlineData();
+		m_capacity = N;
+	}
+
+	bool isInline() const { return m_data == inlineData(); }
+
+private:
+	T* inlineData() const { return (T*)m_inline; }
+
+	// this must be empty
+	void steal(SmallArray<T, N>& rhs)
+	{
+		ASSERT(m_size == 0 && isInline());
+		if (rhs.isInline()) {
+			this->moveRange(m_data, rhs.m_data, rhs.m_size);
+			m_size = rhs.m_size;
+		}
+		else {
+			m_data = rhs.m_data;
+			m_capacity = rhs.m_capacity;
+			m_size = rhs.m_size;
+			rhs.m_data = rhs.inlineData();
+			rhs.m_capacity = N;
+		}
+		rhs.m_size = 0;
+	}
+
+	alignas(T) u8 m_inline[sizeof(T) * N];
+};
+
 } // namespace Lumix
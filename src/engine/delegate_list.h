@@ -62,7 +62,7 @@ template <typename R, typename... Args> struct DelegateList<R(Args...)> {
 	}
 
 private:
-	Array<Delegate<R(Args...)>> m_delegates;
+	SmallArray<Delegate<R(Args...)>, 4> m_delegates;
 };
 
 } // namespace Lumix
@@ -1,3 +1,4 @@
+#include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/crc32.h"
 #include "engine/debug.h"
@@ -66,8 +67,10 @@ public:
 
 	EngineImpl(InitArgs&& init_data, IAllocator& allocator)
 		: m_allocator(allocator)
-		, m_prefab_resource_manager(m_allocator)
-		, m_resource_manager(m_allocator)
+		, m_frame_allocator(m_allocator, 1, 64 * 1024 * 1024)
+		, m_resource_allocator(m_allocator, "resources")
+		, m_prefab_resource_manager(m_resource_allocator)
+		, m_resource_manager(m_resource_allocator)
 		, m_lua_resources(m_allocator)
 		, m_last_lua_resource_idx(-1)
 		, m_is_game_running(false)
@@ -77,13 +80,16 @@ public:
 		, m_next_frame(false)
 	{
 		os::init();
-		os::InitWindowArgs init_win_args;
-		init_win_args.fullscreen = init_data.fullscreen;
-		init_win_args.handle_file_drops = init_data.handle_file_drops;
-		init_win_args.name = init_data.window_title;
-		m_window_handle = os::createWindow(init_win_args);
-		if (m_window_handle == os::INVALID_WINDOW) {
-			logError("Failed to create main window.");
+		m_page_allocator.enableHugePages(init_data.huge_pages);
+		if (!init_data.headless) {
+			os::InitWindowArgs init_win_args;
+			init_win_args.fullscreen = init_data.fullscreen;
+			init_win_args.handle_file_drops = init_data.handle_file_drops;
+			init_win_args.name = init_data.window_title;
+			m_window_handle = os::createWindow(init_win_args);
+			if (m_window_handle == os::INVALID_WINDOW) {
+				logError("Failed to create main window.");
+			}
 		}
 
 		m_is_log_file_open = m_log_file.open("lumix.log");
@@ -106,12 +112,12 @@ public:
 			m_file_system = static_cast<UniquePtr<FileSystem>&&>(init_data.file_system);
 		}
 		else if (init_data.working_dir) {
-			m_file_system = FileSystem::create(init_data.working_dir, m_allocator);
+			m_file_system = FileSystem::create(init_data.working_dir, m_resource_allocator);
 		}
 		else {
 			char current_dir[LUMIX_MAX_PATH];
 			os::getCurrentDirectory(Span(current_dir)); 
-			m_file_system = FileSystem::create(current_dir, m_allocator);
+			m_file_system = FileSystem::create(current_dir, m_resource_allocator);
 		}
 
 		m_resource_manager.init(*m_file_system);
@@ -158,7 +164,7 @@ public:
 		unregisterLogCallback<&EngineImpl::logToFile>(this);
 		m_log_file.close();
 		m_is_log_file_open = false;
-		os::destroyWindow(m_window_handle);
+		if (m_window_handle != os::INVALID_WINDOW) os::destroyWindow(m_window_handle);
 	}
 
 	static void logToDebugOutput(LogLevel level, const char* message)
@@ -186,6 +192,7 @@ public:
 	os::WindowHandle getWindowHandle() override { return m_window_handle; }
 	IAllocator& getAllocator() override { return m_allocator; }
 	PageAllocator& getPageAllocator() override { return m_page_allocator; }
+	IAllocator& getFrameAllocator() override { return m_frame_allocator; }
 
 	bool instantiatePrefab(Universe& universe,
 		const struct PrefabResource& prefab,
@@ -248,6 +255,8 @@ public:
 		}
 		LUMIX_DELETE(m_allocator, &universe);
 		m_resource_manager.removeUnreferenced();
+		// culling cells of the whole universe were just freed
+		m_page_allocator.trim();
 	}
 
 
@@ -299,10 +308,18 @@ public:
 	}
 
 
+	void setFixedTimeDelta(float time_delta) override
+	{
+		m_fixed_time_delta = time_delta;
+	}
+
+
 	void update(Universe& context) override
 	{
 		PROFILE_FUNCTION();
+		m_frame_allocator.endFrame();
 		float dt = m_timer.tick() * m_time_multiplier;
+		if (m_fixed_time_delta > 0) dt = m_fixed_time_delta * m_time_multiplier;
 		if (m_next_frame)
 		{
 			m_paused = false;
@@ -326,6 +343,12 @@ public:
 		m_plugin_manager->update(dt, m_paused);
 		m_input_system->update(dt);
 		m_file_system->processCallbacks();
+		jobs::endFrame();
+		TagAllocator::endFrame();
+
+		profiler::counter("allocated pages", m_page_allocator.getAllocatedCount());
+		profiler::counter("reserved pages", m_page_allocator.getReservedCount());
+		profiler::counter("resident resources (MB)", m_resource_manager.getResidentSize() / double(1024 * 1024));
 
 		if (m_next_frame)
 		{
@@ -495,6 +518,8 @@ public:
 private:
 	IAllocator& m_allocator;
 	PageAllocator m_page_allocator;
+	FrameAllocator m_frame_allocator;
+	TagAllocator m_resource_allocator;
 	UniquePtr<FileSystem> m_file_system;
 	ResourceManagerHub m_resource_manager;
 	UniquePtr<PluginManager> m_plugin_manager;
@@ -502,11 +527,12 @@ private:
 	UniquePtr<InputSystem> m_input_system;
 	os::Timer m_timer;
 	float m_time_multiplier;
+	float m_fixed_time_delta = 0;
 	float m_last_time_delta;
 	bool m_is_game_running;
 	bool m_paused;
 	bool m_next_frame;
-	os::WindowHandle m_window_handle;
+	os::WindowHandle m_window_handle = os::INVALID_WINDOW;
 	lua_State* m_state;
 	os::OutputFile m_log_file;
 	bool m_is_log_file_open = false;
@@ -16,6 +16,10 @@ struct LUMIX_ENGINE_API Engine {
 		bool fullscreen = false;
 		bool handle_file_drops = false;
 		const char* window_title = "Lumix App";
+		// back PageAllocator with huge pages where supported, less TLB misses but more memory
+		bool huge_pages = false;
+		// no main window, e.g. for benchmarks on machines without display, renderer can not be used
+		bool headless = false;
 		UniquePtr<struct FileSystem> file_system; 
 	};
 
@@ -35,6 +39,8 @@ struct LUMIX_ENGINE_API Engine {
 	virtual struct ResourceManagerHub& getResourceManager() = 0;
 	virtual struct PageAllocator& getPageAllocator() = 0;
 	virtual IAllocator& getAllocator() = 0;
+	// memory is freed at the beginning of next update, see FrameAllocator
+	virtual IAllocator& getFrameAllocator() = 0;
 	virtual bool instantiatePrefab(Universe& universe,
 		const struct PrefabResource& prefab,
 		const struct DVec3& pos,
@@ -52,6 +58,8 @@ struct LUMIX_ENGINE_API Engine {
 	virtual void serializeProject(OutputMemoryStream& serializer) const = 0;
 	virtual float getLastTimeDelta() const = 0;
 	virtual void setTimeMultiplier(float multiplier) = 0;
+	// in seconds, every update uses this time delta instead of real time, 0 to use real time
+	virtual void setFixedTimeDelta(float time_delta) = 0;
 	virtual void pause(bool pause) = 0;
 	virtual void nextFrame() = 0;
 	virtual lua_State* getState() = 0;
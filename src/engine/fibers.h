@@ -1,9 +1,7 @@
 #pragma once
 
 
-#ifdef __linux__
-	#include <ucontext.h>
-#endif
+#include "engine/lumix.h"
 
 
 namespace Lumix
@@ -22,7 +20,12 @@ namespace Fiber
 	using FiberProc = void(__stdcall *)(void*);
 	constexpr Handle INVALID_FIBER = nullptr;
 #else 
-	using Handle = ucontext_t;
+	struct Handle {
+		void* sp;
+		// mmapped stack including the guard page
+		u8* stack;
+		u32 stack_size;
+	};
 	using FiberProc = void (*)(void*);
 	constexpr Handle INVALID_FIBER = {};
 #endif
@@ -20,12 +20,27 @@
 
 namespace Lumix {
 
+// reads run in parallel, fast drives need several requests in flight
+static constexpr u32 WORKERS_COUNT = 4;
+static constexpr u32 INVALID_INDEX = 0xffFFffFF;
+// handle is index | generation << HANDLE_INDEX_BITS
+static constexpr u32 HANDLE_INDEX_BITS = 20;
+static constexpr u32 HANDLE_INDEX_MASK = (1 << HANDLE_INDEX_BITS) - 1;
+
+
 struct AsyncItem {
 	enum class Flags : u32 {
 		FAILED = 1 << 0,
 		CANCELED = 1 << 1,
 	};
 
+	enum class State : u8 {
+		FREE,
+		QUEUED,
+		LOADING,
+		FINISHED
+	};
+
 	AsyncItem(IAllocator& allocator) : data(allocator) {}
 	
 	bool isFailed() const { return flags.isSet(Flags::FAILED); }
@@ -34,11 +49,49 @@ struct AsyncItem {
 	FileSystem::ContentCallback callback;
 	OutputMemoryStream data;
 	StaticString<LUMIX_MAX_PATH> path;
+	// index in FileSystemImpl::m_items | generation << HANDLE_INDEX_BITS
 	u32 id = 0;
+	// links in one of the lists in FileSystemImpl, depends on state
+	u32 prev = INVALID_INDEX;
+	u32 next = INVALID_INDEX;
+	FileSystem::Priority priority = FileSystem::Priority::NORMAL;
+	State state = State::FREE;
 	FlagSet<Flags, u32> flags;
 };
 
 
+// intrusive FIFO of items
+struct AsyncItemList {
+	bool empty() const { return first == INVALID_INDEX; }
+
+	void push(Span<AsyncItem> items, u32 idx) {
+		items[idx].prev = last;
+		items[idx].next = INVALID_INDEX;
+		if (last != INVALID_INDEX) items[last].next = idx;
+		else first = idx;
+		last = idx;
+	}
+
+	void remove(Span<AsyncItem> items, u32 idx) {
+		AsyncItem& item = items[idx];
+		if (item.prev != INVALID_INDEX) items[item.prev].next = item.next;
+		else first = item.next;
+		if (item.next != INVALID_INDEX) items[item.next].prev = item.prev;
+		else last = item.prev;
+		item.prev = item.next = INVALID_INDEX;
+	}
+
+	u32 pop(Span<AsyncItem> items) {
+		const u32 idx = first;
+		if (idx != INVALID_INDEX) remove(items, idx);
+		return idx;
+	}
+
+	u32 first = INVALID_INDEX;
+	u32 last = INVALID_INDEX;
+};
+
+
 struct FileSystemImpl;
 
 
@@ -50,32 +103,33 @@ struct FSTask final : Thread {
 
 	~FSTask() = default;
 
-	void stop();
 	int task() override;
 
 private:
 	FileSystemImpl& m_fs;
-	bool m_finish = false;
 };
 
 
 struct FileSystemImpl : FileSystem {
 	explicit FileSystemImpl(const char* base_path, IAllocator& allocator)
 		: m_allocator(allocator)
-		, m_queue(allocator)	
-		, m_finished(allocator)	
-		, m_last_id(0)
-		, m_semaphore(0, 0xffFF)
+		, m_items(allocator)
+		, m_semaphore(0, 0x7fffFFFF)
 	{
 		setBasePath(base_path);
-		m_task.create(*this, m_allocator);
-		m_task->create("Filesystem", true);
+		for (Local<FSTask>& task : m_tasks) {
+			task.create(*this, m_allocator);
+			task->create("Filesystem", true);
+		}
 	}
 
 	~FileSystemImpl() override {
-		m_task->stop();
-		m_task->destroy();
-		m_task.destroy();
+		m_finish = true;
+		for (u32 i = 0; i < WORKERS_COUNT; ++i) m_semaphore.signal();
+		for (Local<FSTask>& task : m_tasks) {
+			task->destroy();
+			task.destroy();
+		}
 	}
 
 
@@ -110,37 +164,105 @@ struct FileSystemImpl : FileSystem {
 		return true;
 	}
 
-	AsyncHandle getContent(const Path& file, const ContentCallback& callback) override
+	// mutex must be locked
+	AsyncItem* getItem(AsyncHandle handle) {
+		const u32 idx = handle.value & HANDLE_INDEX_MASK;
+		if (!handle.isValid() || idx >= (u32)m_items.size()) return nullptr;
+		AsyncItem& item = m_items[idx];
+		if (item.id != handle.value || item.state == AsyncItem::State::FREE) return nullptr;
+		return &item;
+	}
+
+	// mutex must be locked, returns INVALID_INDEX if there are too many requests in flight
+	u32 allocItem() {
+		if (m_free_items != INVALID_INDEX) {
+			const u32 idx = m_free_items;
+			m_free_items = m_items[idx].next;
+			m_items[idx].next = INVALID_INDEX;
+			return idx;
+		}
+		const u32 idx = m_items.size();
+		// last index with the last generation would be invalid handle
+		if (idx >= HANDLE_INDEX_MASK) return INVALID_INDEX;
+		m_items.emplace(m_allocator);
+		return idx;
+	}
+
+	// mutex must be locked, item must not be in any list
+	void freeItem(u32 idx) {
+		AsyncItem& item = m_items[idx];
+		item.state = AsyncItem::State::FREE;
+		item.flags.clear();
+		item.callback = {};
+		item.data.clear();
+		// handles of freed items do not match reused item
+		item.id = ((item.id >> HANDLE_INDEX_BITS) + 1) << HANDLE_INDEX_BITS | idx;
+		item.next = m_free_items;
+		m_free_items = idx;
+		ASSERT(m_work_counter > 0);
+		--m_work_counter;
+	}
+
+	AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority) override
 	{
 		if (!file.isValid()) return AsyncHandle::invalid();
 
 		MutexGuard lock(m_mutex);
+		const u32 idx = allocItem();
+		if (idx == INVALID_INDEX) {
+			logError("Too many pending file requests, can not load ", file.c_str());
+			return AsyncHandle::invalid();
+		}
 		++m_work_counter;
-		AsyncItem& item = m_queue.emplace(m_allocator);
-		++m_last_id;
-		if (m_last_id == 0) ++m_last_id;
-		item.id = m_last_id;
+		AsyncItem& item = m_items[idx];
+		item.id = (item.id & ~HANDLE_INDEX_MASK) | idx;
 		item.path = file.c_str();
 		item.callback = callback;
+		item.priority = priority;
+		item.state = AsyncItem::State::QUEUED;
+		m_queues[(u32)priority].push(m_items, idx);
 		m_semaphore.signal();
 		return AsyncHandle(item.id);
 	}
 
 
-	void cancel(AsyncHandle async) override
+	void setPriority(AsyncHandle async, Priority priority) override
 	{
 		MutexGuard lock(m_mutex);
-		for (AsyncItem& item : m_queue) {
-			if (item.id == async.value) {
-				item.flags.set(AsyncItem::Flags::CANCELED);
-				return;
-			}
+		AsyncItem* item = getItem(async);
+		if (!item || item->priority == priority) return;
+
+		if (item->state == AsyncItem::State::QUEUED) {
+			const u32 idx = async.value & HANDLE_INDEX_MASK;
+			m_queues[(u32)item->priority].remove(m_items, idx);
+			m_queues[(u32)priority].push(m_items, idx);
 		}
-		for (AsyncItem& item : m_finished) {
-			if (item.id == async.value) {
-				item.flags.set(AsyncItem::Flags::CANCELED);
-				return;
-			}
+		item->priority = priority;
+	}
+
+
+	void cancel(AsyncHandle async) override
+	{
+		MutexGuard lock(m_mutex);
+		AsyncItem* item = getItem(async);
+		if (!item) return;
+
+		const u32 idx = async.value & HANDLE_INDEX_MASK;
+		switch (item->state) {
+			case AsyncItem::State::QUEUED:
+				// worker woken by the semaphore finds nothing and waits again
+				m_queues[(u32)item->priority].remove(m_items, idx);
+				freeItem(idx);
+				break;
+			case AsyncItem::State::LOADING:
+				// freed by the worker once the read is done
+				item->flags.set(AsyncItem::Flags::CANCELED);
+				break;
+			case AsyncItem::State::FINISHED:
+				m_finished.remove(m_items, idx);
+				freeItem(idx);
+				break;
+			case AsyncItem::State::FREE: ASSERT(false); break;
 		}
 	}
 
@@ -236,16 +358,17 @@ struct FileSystemImpl : FileSystem {
 				break;
 			}
 
-			AsyncItem item = static_cast<AsyncItem&&>(m_finished[0]);
-			m_finished.erase(0);
-			ASSERT(m_work_counter > 0);
-			--m_work_counter;
+			const u32 idx = m_finished.pop(m_items);
+			AsyncItem& item = m_items[idx];
+			const ContentCallback callback = item.callback;
+			const bool success = !item.isFailed();
+			// item can be reused once the mutex is released
+			OutputMemoryStream data(static_cast<OutputMemoryStream&&>(item.data));
+			freeItem(idx);
 
 			m_mutex.exit();
 
-			if(!item.isCanceled()) {
-				item.callback.invoke(item.data.size(), (const u8*)item.data.data(), !item.isFailed());
-			}
+			callback.invoke(data.size(), (const u8*)data.data(), success);
 
 			if (timer.getTimeSinceStart() > 0.1f) {
 				break;
@@ -254,33 +377,40 @@ struct FileSystemImpl : FileSystem {
 	}
 
 	IAllocator& m_allocator;
-	Local<FSTask> m_task;
+	Local<FSTask> m_tasks[WORKERS_COUNT];
 	StaticString<LUMIX_MAX_PATH> m_base_path;
-	Array<AsyncItem> m_queue;
+	// items are never removed, free ones are reused, see m_free_items
+	Array<AsyncItem> m_items;
+	AsyncItemList m_queues[(u32)Priority::COUNT];
+	AsyncItemList m_finished;
+	// linked by AsyncItem::next
+	u32 m_free_items = INVALID_INDEX;
 	u32 m_work_counter = 0;
-	Array<AsyncItem> m_finished;
 	Mutex m_mutex;
 	Semaphore m_semaphore;
-
-	u32 m_last_id;
+	volatile bool m_finish = false;
 };
 
 
 int FSTask::task()
 {
-	while (!m_finish) {
+	for (;;) {
 		m_fs.m_semaphore.wait();
-		if (m_finish) break;
+		if (m_fs.m_finish) break;
 
+		u32 idx = INVALID_INDEX;
 		StaticString<LUMIX_MAX_PATH> path;
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			ASSERT(!m_fs.m_queue.empty());
-			path = m_fs.m_queue[0].path;
-			if (m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_queue.erase(0);
-				continue;
+			for (AsyncItemList& queue : m_fs.m_queues) {
+				idx = queue.pop(m_fs.m_items);
+				if (idx != INVALID_INDEX) break;
 			}
+			// canceled
+			if (idx == INVALID_INDEX) continue;
+			AsyncItem& item = m_fs.m_items[idx];
+			item.state = AsyncItem::State::LOADING;
+			path = item.path;
 		}
 
 		OutputMemoryStream data(m_fs.m_allocator);
@@ -288,26 +418,20 @@ int FSTask::task()
 
 		{
 			MutexGuard lock(m_fs.m_mutex);
-			if (!m_fs.m_queue[0].isCanceled()) {
-				m_fs.m_finished.emplace(static_cast<AsyncItem&&>(m_fs.m_queue[0]));
-				m_fs.m_finished.back().data = static_cast<OutputMemoryStream&&>(data);
-				if(!success) {
-					m_fs.m_finished.back().flags.set(AsyncItem::Flags::FAILED);
-				}
+			AsyncItem& item = m_fs.m_items[idx];
+			if (item.isCanceled()) {
+				m_fs.freeItem(idx);
+				continue;
 			}
-			m_fs.m_queue.erase(0);
+			item.data = static_cast<OutputMemoryStream&&>(data);
+			if (!success) item.flags.set(AsyncItem::Flags::FAILED);
+			item.state = AsyncItem::State::FINISHED;
+			m_fs.m_finished.push(m_fs.m_items, idx);
 		}
 	}
 	return 0;
 }
 
-
-void FSTask::stop()
-{
-	m_finish = true;
-	m_fs.m_semaphore.signal();
-}
-
 struct PackFileSystem : FileSystemImpl {
 	PackFileSystem(const char* pak_path, IAllocator& allocator) 
 		: FileSystemImpl("pack://", allocator) 
@@ -344,11 +468,14 @@ struct PackFileSystem : FileSystemImpl {
 
 		OutputMemoryStream compressed(m_allocator);
 		compressed.resize(iter.value().compressed_size);
-		MutexGuard lock(m_mutex);
-		const u32 header_size = sizeof(u32) + m_map.size() * (3 * sizeof(u64) + sizeof(u32));
-		if (!m_file.seek(iter.value().offset + header_size) || !m_file.read(compressed.getMutableData(), compressed.size())) {
-			logError("Could not read ", path);
-			return false;
+		{
+			// only the read is serialized, several workers can decompress at once
+			MutexGuard lock(m_mutex);
+			const u32 header_size = sizeof(u32) + m_map.size() * (3 * sizeof(u64) + sizeof(u32));
+			if (!m_file.seek(iter.value().offset + header_size) || !m_file.read(compressed.getMutableData(), compressed.size())) {
+				logError("Could not read ", path);
+				return false;
+			}
 		}
 
 		content->resize(iter.value().size);
@@ -23,6 +23,15 @@ struct LUMIX_ENGINE_API FileSystem {
 		bool isValid() const { return value != 0xffFFffFF; }
 	};
 
+	// requests with higher priority are read first, requests with the same priority in FIFO order
+	enum class Priority : u8 {
+		HIGH,
+		NORMAL,
+		LOW,
+
+		COUNT
+	};
+
 	static UniquePtr<FileSystem> create(const char* base_path, struct IAllocator& allocator);
 	static UniquePtr<FileSystem> createPacked(const char* pak_path, struct IAllocator& allocator);
 
@@ -45,7 +54,9 @@ struct LUMIX_ENGINE_API FileSystem {
 	virtual void makeAbsolute(Span<char> absolute, const char* relative) const = 0;
 
 	[[nodiscard]] virtual bool getContentSync(const struct Path& file, Ref<struct OutputMemoryStream> content) =  0;
-	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback) = 0;
+	virtual AsyncHandle getContent(const Path& file, const ContentCallback& callback, Priority priority = Priority::NORMAL) = 0;
+	// no effect if the file is already being read
+	virtual void setPriority(AsyncHandle handle, Priority priority) = 0;
 	virtual void cancel(AsyncHandle handle) = 0;
 };
 
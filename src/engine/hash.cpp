@@ -0,0 +1,86 @@
+#include "engine/hash.h"
+#include "engine/crt.h"
+
+#if defined(_WIN32) && defined(_M_X64)
+	#include <intrin.h>
+#endif
+
+
+namespace Lumix
+{
+
+
+// based on wyhash final 4, https://github.com/wangyi-fudan/wyhash (public domain)
+static constexpr u64 WY_SECRET[4] = { 0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull };
+
+// 64x64 -> 128 multiplication, low half in a, high half in b
+static LUMIX_FORCE_INLINE void mul128(u64& a, u64& b) {
+	#if defined(_WIN32) && defined(_M_X64)
+		a = _umul128(a, b, &b);
+	#else
+		const unsigned __int128 r = (unsigned __int128)a * b;
+		a = (u64)r;
+		b = (u64)(r >> 64);
+	#endif
+}
+
+static LUMIX_FORCE_INLINE u64 mix(u64 a, u64 b) {
+	mul128(a, b);
+	return a ^ b;
+}
+
+static LUMIX_FORCE_INLINE u64 read8(const u8* p) { u64 v; memcpy(&v, p, 8); return v; }
+static LUMIX_FORCE_INLINE u64 read4(const u8* p) { u32 v; memcpy(&v, p, 4); return v; }
+static LUMIX_FORCE_INLINE u64 read3(const u8* p, u64 k) { return (u64(p[0]) << 16) | (u64(p[k >> 1]) << 8) | p[k - 1]; }
+
+
+u64 hash64(const void* data, u64 length, u64 seed)
+{
+	const u8* p = (const u8*)data;
+	seed ^= mix(seed ^ WY_SECRET[0], WY_SECRET[1]);
+	u64 a, b;
+	if (length <= 16) {
+		if (length >= 4) {
+			// two overlapping reads from each end cover 4..16 bytes
+			const u64 mid = (length >> 3) << 2;
+			a = (read4(p) << 32) | read4(p + mid);
+			b = (read4(p + length - 4) << 32) | read4(p + length - 4 - mid);
+		}
+		else if (length > 0) {
+			a = read3(p, length);
+			b = 0;
+		}
+		else {
+			a = b = 0;
+		}
+	}
+	else {
+		u64 i = length;
+		if (i > 48) {
+			u64 seed1 = seed;
+			u64 seed2 = seed;
+			do {
+				seed = mix(read8(p) ^ WY_SECRET[1], read8(p + 8) ^ seed);
+				seed1 = mix(read8(p + 16) ^ WY_SECRET[2], read8(p + 24) ^ seed1);
+				seed2 = mix(read8(p + 32) ^ WY_SECRET[3], read8(p + 40) ^ seed2);
+				p += 48;
+				i -= 48;
+			} while (i > 48);
+			seed ^= seed1 ^ seed2;
+		}
+		while (i > 16) {
+			seed = mix(read8(p) ^ WY_SECRET[1], read8(p + 8) ^ seed);
+			i -= 16;
+			p += 16;
+		}
+		a = read8(p + i - 16);
+		b = read8(p + i - 8);
+	}
+	a ^= WY_SECRET[1];
+	b ^= seed;
+	mul128(a, b);
+	return mix(a ^ WY_SECRET[0] ^ length, b ^ WY_SECRET[1]);
+}
+
+
+} // namespace Lumix
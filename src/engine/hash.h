@@ -0,0 +1,16 @@
+#pragma once
+
+
+#include "engine/lumix.h"
+
+
+namespace Lumix
+{
+
+
+// fast non-cryptographic hash (wyhash), for in-memory tables only
+// result can differ between versions, do not store it in files, use crc32 for that
+LUMIX_ENGINE_API u64 hash64(const void* data, u64 length, u64 seed = 0);
+
+
+} // namespace Lumix
@@ -2,8 +2,16 @@
 
 
 #include "engine/allocator.h"
+#include "engine/crt.h"
 #include "engine/lumix.h"
 
+#if defined(_M_X64) || defined(__x86_64__)
+	#include <emmintrin.h>
+#endif
+#ifdef _WIN32
+	#include <intrin.h>
+#endif
+
 
 namespace Lumix
 {
@@ -125,14 +133,79 @@ struct HashFuncDirect {
 	static u32 get(T key) { return key; }
 };
 
+namespace detail {
+
+// 16 control bytes of HashMap probed at once
+struct HashMapGroup {
+	static constexpr u32 WIDTH = 16;
+	// full slots store top 7 bits of the hash, so they are never negative
+	static constexpr i8 EMPTY = -128;
+	static constexpr i8 DELETED = -2;
+
+	#if defined(_M_X64) || defined(__x86_64__)
+		explicit LUMIX_FORCE_INLINE HashMapGroup(const i8* ctrl) : ctrl(_mm_loadu_si128((const __m128i*)ctrl)) {}
+		LUMIX_FORCE_INLINE u32 match(i8 h2) const { return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2), ctrl)); }
+		LUMIX_FORCE_INLINE u32 matchEmpty() const { return match(EMPTY); }
+		LUMIX_FORCE_INLINE u32 matchEmptyOrDeleted() const { return (u32)_mm_movemask_epi8(ctrl); }
+		LUMIX_FORCE_INLINE u32 matchFull() const { return ~matchEmptyOrDeleted() & 0xffFF; }
+
+		__m128i ctrl;
+	#else
+		explicit HashMapGroup(const i8* ctrl) : ctrl(ctrl) {}
+		u32 match(i8 h2) const {
+			u32 res = 0;
+			for (u32 i = 0; i < WIDTH; ++i) res |= u32(ctrl[i] == h2) << i;
+			return res;
+		}
+		u32 matchEmpty() const { return match(EMPTY); }
+		u32 matchEmptyOrDeleted() const {
+			u32 res = 0;
+			for (u32 i = 0; i < WIDTH; ++i) res |= u32(ctrl[i] < 0) << i;
+			return res;
+		}
+		u32 matchFull() const { return ~matchEmptyOrDeleted() & 0xffFF; }
+
+		const i8* ctrl;
+	#endif
+
+	// mask must not be 0
+	static LUMIX_FORCE_INLINE u32 lowestBit(u32 mask) {
+		#ifdef _WIN32
+			unsigned long res;
+			_BitScanForward(&res, mask);
+			return res;
+		#else
+			return __builtin_ctz(mask);
+		#endif
+	}
+
+	static LUMIX_FORCE_INLINE u32 highestBit(u32 mask) {
+		#ifdef _WIN32
+			unsigned long res;
+			_BitScanReverse(&res, mask);
+			return res;
+		#else
+			return 31 - __builtin_clz(mask);
+		#endif
+	}
+};
+
+} // namespace detail
+
+// open addressing with SIMD probing, see https://abseil.io/about/design/swisstables
+// each slot has a control byte - empty, deleted (tombstone) or top 7 bits of the key's hash
+// first WIDTH control bytes are mirrored after the last one, so a group can be loaded at any position
 template<typename Key, typename Value, typename Hasher = HashFunc<Key>>
 struct HashMap
 {
 private:
+	using Group = detail::HashMapGroup;
+	static constexpr u32 WIDTH = Group::WIDTH;
+
+	// key and value together, so a hit touches only ctrl and one slot
 	struct Slot {
-		u8 key_mem[sizeof(Key)];
-		bool valid;
-		//u8 padding[3];
+		Key key;
+		Value value;
 	};
 
 	template <typename HM, typename K, typename V>
@@ -152,35 +225,26 @@ private:
 			return idx == rhs.idx;
 		}
 
-		void operator++() { 
-			const Slot* keys = hm->m_keys;
-			for(u32 i = idx + 1, c = hm->m_capacity; i < c; ++i) {
-				if(keys[i].valid) {
-					idx = i;
-					return;
-				}
-			}
-			idx = hm->m_capacity;
-		}
+		void operator++() { idx = hm->nextFull(idx + 1); }
 
 		K& key() {
-			ASSERT(hm->m_keys[idx].valid);
-			return *((Key*)hm->m_keys[idx].key_mem);
+			ASSERT(hm->m_ctrl[idx] >= 0);
+			return hm->m_slots[idx].key;
 		}
 
 		const V& value() const {
-			ASSERT(hm->m_keys[idx].valid);
-			return hm->m_values[idx];
+			ASSERT(hm->m_ctrl[idx] >= 0);
+			return hm->m_slots[idx].value;
 		}
 
 		V& value() {
-			ASSERT(hm->m_keys[idx].valid);
-			return hm->m_values[idx];
+			ASSERT(hm->m_ctrl[idx] >= 0);
+			return hm->m_slots[idx].value;
 		}
 
 		V& operator*() {
-			ASSERT(hm->m_keys[idx].valid);
-			return hm->m_values[idx];
+			ASSERT(hm->m_ctrl[idx] >= 0);
+			return hm->m_slots[idx].value;
 		}
 
 		bool isValid() const { return idx != hm->m_capacity; }
@@ -198,68 +262,45 @@ public:
 	HashMap(u32 size, IAllocator& allocator) 
 		: m_allocator(allocator) 
 	{
-		init(size, true);
+		init(size);
 	}
 
 	HashMap(HashMap&& rhs)
 		: m_allocator(rhs.m_allocator)
 	{
-		m_keys = rhs.m_keys;
-		m_values = rhs.m_values;
+		m_ctrl = rhs.m_ctrl;
+		m_slots = rhs.m_slots;
 		m_capacity = rhs.m_capacity;
 		m_size = rhs.m_size;
 		m_mask = rhs.m_mask;
+		m_growth_left = rhs.m_growth_left;
 		
-		rhs.m_keys = nullptr;
-		rhs.m_values = nullptr;
+		rhs.m_ctrl = nullptr;
+		rhs.m_slots = nullptr;
 		rhs.m_capacity = 0;
 		rhs.m_size = 0;
 		rhs.m_mask = 0;
+		rhs.m_growth_left = 0;
 	}
 
 	~HashMap()
 	{
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
-		m_allocator.deallocate(m_keys);
-		m_allocator.deallocate(m_values);
+		destroyAll();
+		deallocate();
 	}
 
 	void operator =(HashMap&& rhs) = delete;
 
-	iterator begin() {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
-	}
-
-	const_iterator begin() const {
-		for (u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) return { this, i };
-		}
-		return { this, m_capacity };
-	}
+	iterator begin() { return { this, nextFull(0) }; }
+	const_iterator begin() const { return { this, nextFull(0) }; }
 
 	iterator end() { return iterator { this, m_capacity }; }
 	const_iterator end() const { return const_iterator { this, m_capacity }; }
 
 	void clear() {
-		for(u32 i = 0, c = m_capacity; i < c; ++i) {
-			if (m_keys[i].valid) {
-				((Key*)m_keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				m_keys[i].valid = false;
-			}
-		}
-		m_allocator.deallocate(m_keys);
-		m_allocator.deallocate(m_values);
-		init(8, true);
+		destroyAll();
+		deallocate();
+		init(8);
 	}
 
 	const_iterator find(const Key& key) const {
@@ -273,13 +314,13 @@ public:
 	Value& operator[](const Key& key) {
 		const u32 pos = findPos(key);
 		ASSERT(pos < m_capacity);
-		return m_values[pos];
+		return m_slots[pos].value;
 	}
 	
 	const Value& operator[](const Key& key) const {
 		const u32 pos = findPos(key);
 		ASSERT(pos < m_capacity);
-		return m_values[pos];
+		return m_slots[pos].value;
 	}
 
 	Value& insert(const Key& key) {
@@ -288,93 +329,46 @@ public:
 	}
 
 	iterator insert(const Key& key, Value&& value) {
-		if (m_size >= m_capacity * 3 / 4) {
-			grow((m_capacity << 1) < 8 ? 8 : m_capacity << 1);
-		}
-
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
-
-		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
-		new (NewPlaceholder(), &m_values[pos]) Value(static_cast<Value&&>(value));
-		++m_size;
-		m_keys[pos].valid = true;
-
+		const u32 hash = Hasher::get(key);
+		const u32 pos = prepareInsert(hash);
+		new (NewPlaceholder(), &m_slots[pos].key) Key(key);
+		new (NewPlaceholder(), &m_slots[pos].value) Value(static_cast<Value&&>(value));
 		return { this, pos };
 	}
 
 	iterator insert(const Key& key, const Value& value) {
-		if (m_size >= m_capacity * 3 / 4) {
-			grow((m_capacity << 1) < 8 ? 8 : m_capacity << 1);
-		}
-
-		u32 pos = Hasher::get(key) & m_mask;
-		while (m_keys[pos].valid) ++pos;
-		if(pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid) ++pos;
-		}
-
-		new (NewPlaceholder(), m_keys[pos].key_mem) Key(key);
-		new (NewPlaceholder(), &m_values[pos]) Value(value);
-		++m_size;
-		m_keys[pos].valid = true;
-
+		const u32 hash = Hasher::get(key);
+		const u32 pos = prepareInsert(hash);
+		new (NewPlaceholder(), &m_slots[pos].key) Key(key);
+		new (NewPlaceholder(), &m_slots[pos].value) Value(value);
 		return { this, pos };
 	}
 
 	template <typename F>
 	void eraseIf(F predicate) {
-		Slot* keys = m_keys;
 		for (u32 i = 0; i < m_capacity; ++i) {
-			if (!keys[i].valid) continue;
-			if (predicate(m_values[i])) {
-				((Key*)keys[i].key_mem)->~Key();
-				m_values[i].~Value();
-				keys[i].valid = false;
-				--m_size;
-
-				u32 pos = (i + 1) % m_capacity;
-				while (keys[pos].valid) {
-					rehash(pos);
-					pos = (pos + 1) % m_capacity;
-				}
-				--i;
-			}
+			if (m_ctrl[i] < 0) continue;
+			if (predicate(m_slots[i].value)) eraseAt(i);
 		}
 	}
 
+	// does not move other elements, so iterators stay valid except the erased one
 	void erase(const iterator& key) {
 		ASSERT(key.isValid());
-
-		Slot* keys = m_keys;
-		u32 pos = key.idx;
-		((Key*)keys[pos].key_mem)->~Key();
-		m_values[pos].~Value();
-		keys[pos].valid = false;
-		--m_size;
-
-		pos = (pos + 1) & m_mask;
-		while (keys[pos].valid) {
-			rehash(pos);
-			pos = (pos + 1) % m_capacity;
-		}
+		eraseAt(key.idx);
 	}
 
 	void erase(const Key& key) {
 		const u32 pos = findPos(key);
-		if (m_keys[pos].valid) erase({this, pos});
+		if (pos != m_capacity) eraseAt(pos);
 	}
 
 	bool empty() const { return m_size == 0; }
 	u32 size() const { return m_size; }
 
+	// new_capacity elements can be inserted without growing
 	void reserve(u32 new_capacity) {
-		if (new_capacity > m_capacity) grow(nextPow2(new_capacity));
+		if (new_capacity > m_size + m_growth_left) grow(nextPow2(new_capacity + new_capacity / 7 + 1));
 	}
 
 private:
@@ -396,88 +390,161 @@ private:
 		return v;
 	}
 
-	void grow(u32 new_capacity) {
-		HashMap<Key, Value, Hasher> tmp(new_capacity, m_allocator);
-		if (m_size > 0) {
-			for(auto iter = begin(); iter.isValid(); ++iter) {
-				tmp.insert(iter.key(), static_cast<Value&&>(iter.value()));
-			}
+	// max load factor 7/8, small tables keep at least one empty slot so probing terminates
+	static u32 maxLoad(u32 capacity) { return capacity < 8 ? capacity - 1 : capacity - capacity / 8; }
+	static i8 getH2(u32 hash) { return i8(hash >> 25); }
+
+	void setCtrl(u32 pos, i8 value) {
+		m_ctrl[pos] = value;
+		// mirrored bytes, tables smaller than a group are mirrored more than once
+		for (u32 i = pos + m_capacity; i < m_capacity + WIDTH; i += m_capacity) {
+			m_ctrl[i] = value;
 		}
+	}
 
-		swap(m_capacity, tmp.m_capacity);
-		swap(m_size, tmp.m_size);
-		swap(m_mask, tmp.m_mask);
-		swap(m_keys, tmp.m_keys);
-		swap(m_values, tmp.m_values);
+	u32 nextFull(u32 from) const {
+		// mirrored bytes make reading ctrl[m_capacity] safe
+		if (m_ctrl && m_ctrl[from] >= 0 && from < m_capacity) return from;
+		for (u32 i = from; i < m_capacity; i += WIDTH) {
+			u32 mask = Group(m_ctrl + i).matchFull();
+			// ignore mirrored bytes
+			if (m_capacity - i < WIDTH) mask &= (1 << (m_capacity - i)) - 1;
+			if (mask) return i + Group::lowestBit(mask);
+		}
+		return m_capacity;
+	}
+
+	// first empty or deleted slot on key's probe sequence
+	u32 findInsertPos(u32 hash) const {
+		u32 pos = hash & m_mask;
+		u32 step = 0;
+		for (;;) {
+			const u32 mask = Group(m_ctrl + pos).matchEmptyOrDeleted();
+			if (mask) return (pos + Group::lowestBit(mask)) & m_mask;
+			// triangular numbers visit all groups in power of 2 sized table
+			step += WIDTH;
+			pos = (pos + step) & m_mask;
+		}
 	}
 
-	u32 findEmptySlot(const Key& key, u32 end_pos) const {
-		const u32 mask = m_mask;
-		u32 pos = Hasher::get(key) & mask;
-		while (m_keys[pos].valid && pos != end_pos) ++pos;
-		if (pos == m_capacity) {
-			pos = 0;
-			while (m_keys[pos].valid && pos != end_pos) ++pos;
+	u32 prepareInsert(u32 hash) {
+		if (m_growth_left == 0) {
+			// lot of tombstones, rehash in place, otherwise double the capacity
+			const u32 new_capacity = m_size < maxLoad(m_capacity) / 2 ? m_capacity : m_capacity << 1;
+			grow(new_capacity < 8 ? 8 : new_capacity);
 		}
+		const u32 pos = findInsertPos(hash);
+		if (m_ctrl[pos] == Group::EMPTY) --m_growth_left;
+		setCtrl(pos, getH2(hash));
+		++m_size;
 		return pos;
 	}
 
-	void rehash(u32 pos) {
-		Key& key = *((Key*)m_keys[pos].key_mem);
-		const u32 rehashed_pos = findEmptySlot(key, pos);
-		if (rehashed_pos != pos) {
-			new (NewPlaceholder(), m_keys[rehashed_pos].key_mem) Key(static_cast<Key&&>(key));
-			new (NewPlaceholder(), &m_values[rehashed_pos]) Value(static_cast<Value&&>(m_values[pos]));
-			
-			((Key*)m_keys[pos].key_mem)->~Key();
-			m_values[pos].~Value();
-			m_keys[pos].valid = false;
-			m_keys[rehashed_pos].valid = true;
+	void eraseAt(u32 pos) {
+		ASSERT(m_ctrl[pos] >= 0);
+		m_slots[pos].key.~Key();
+		m_slots[pos].value.~Value();
+		--m_size;
+
+		// slot can be empty if no probe sequence has ever passed it, i.e. it was never part of a full group
+		bool can_be_empty = m_capacity <= WIDTH;
+		if (!can_be_empty) {
+			const u32 empty_before = Group(m_ctrl + ((pos - WIDTH) & m_mask)).matchEmpty();
+			const u32 empty_after = Group(m_ctrl + pos).matchEmpty();
+			if (empty_before && empty_after) {
+				const u32 full_before = WIDTH - 1 - Group::highestBit(empty_before);
+				const u32 full_after = Group::lowestBit(empty_after);
+				can_be_empty = full_before + full_after < WIDTH;
+			}
+		}
+
+		if (can_be_empty) {
+			setCtrl(pos, Group::EMPTY);
+			++m_growth_left;
+		}
+		else {
+			setCtrl(pos, Group::DELETED);
 		}
 	}
 
+	void grow(u32 new_capacity) {
+		HashMap<Key, Value, Hasher> tmp(new_capacity, m_allocator);
+		for (u32 i = 0; i < m_capacity; ++i) {
+			if (m_ctrl[i] < 0) continue;
+			// keys are unique, no need to compare them
+			const u32 hash = Hasher::get(m_slots[i].key);
+			const u32 pos = tmp.findInsertPos(hash);
+			tmp.setCtrl(pos, getH2(hash));
+			new (NewPlaceholder(), &tmp.m_slots[pos].key) Key(static_cast<Key&&>(m_slots[i].key));
+			new (NewPlaceholder(), &tmp.m_slots[pos].value) Value(static_cast<Value&&>(m_slots[i].value));
+		}
+		tmp.m_size = m_size;
+		tmp.m_growth_left = maxLoad(new_capacity) - m_size;
+
+		swap(m_capacity, tmp.m_capacity);
+		swap(m_size, tmp.m_size);
+		swap(m_mask, tmp.m_mask);
+		swap(m_growth_left, tmp.m_growth_left);
+		swap(m_ctrl, tmp.m_ctrl);
+		swap(m_slots, tmp.m_slots);
+	}
+
 	u32 findPos(const Key& key) const {
-		u32 pos = Hasher::get(key) & m_mask;
-		const Slot* LUMIX_RESTRICT keys = m_keys;
-		if (!keys) {
+		if (!m_ctrl) {
 			ASSERT(m_capacity == 0);
 			return 0;
 		}
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
+		const u32 hash = Hasher::get(key);
+		const i8 h2 = getH2(hash);
+		const Slot* LUMIX_RESTRICT slots = m_slots;
+		u32 pos = hash & m_mask;
+		u32 step = 0;
+		for (;;) {
+			const Group group(m_ctrl + pos);
+			for (u32 mask = group.match(h2); mask; mask &= mask - 1) {
+				const u32 idx = (pos + Group::lowestBit(mask)) & m_mask;
+				if (slots[idx].key == key) return idx;
+			}
+			if (group.matchEmpty()) return m_capacity;
+			step += WIDTH;
+			pos = (pos + step) & m_mask;
 		}
-		if (pos != m_capacity) return m_capacity;
-		pos = 0;
-		while (keys[pos].valid) {
-			if (*((Key*)keys[pos].key_mem) == key) return pos;
-			++pos;
+	}
+
+	void destroyAll() {
+		for (u32 i = 0, c = m_capacity; i < c; ++i) {
+			if (m_ctrl[i] >= 0) {
+				m_slots[i].key.~Key();
+				m_slots[i].value.~Value();
+			}
 		}
-		return m_capacity;
 	}
 
-	void init(u32 capacity, bool all_invalid) {
+	void deallocate() {
+		m_allocator.deallocate(m_ctrl);
+		m_allocator.deallocate(m_slots);
+	}
+
+	void init(u32 capacity) {
 		const bool is_pow_2 = capacity && !(capacity & (capacity - 1));
 		ASSERT(is_pow_2);
 		m_size = 0;
 		m_mask = capacity - 1;
-		m_keys = (Slot*)m_allocator.allocate(sizeof(Slot) * (capacity + 1));
-		m_values = (Value*)m_allocator.allocate(sizeof(Value) * capacity);
+		m_growth_left = maxLoad(capacity);
+		m_ctrl = (i8*)m_allocator.allocate(capacity + WIDTH);
+		m_slots = (Slot*)m_allocator.allocate(sizeof(Slot) * capacity);
 		m_capacity = capacity;
-		if (all_invalid) {
-			for(u32 i = 0; i < capacity; ++i) {
-				m_keys[i].valid = false;
-			}
-		}
-		m_keys[capacity].valid = false;
+		memset(m_ctrl, Group::EMPTY, capacity + WIDTH);
 	}
 
 	IAllocator& m_allocator;
-	Slot* m_keys = nullptr;
-	Value* m_values = nullptr;
+	i8* m_ctrl = nullptr;
+	Slot* m_slots = nullptr;
 	u32 m_capacity = 0;
 	u32 m_size = 0;
 	u32 m_mask = 0;
+	// number of empty slots which can be filled before rehash
+	u32 m_growth_left = 0;
 };
 
 
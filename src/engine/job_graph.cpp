@@ -0,0 +1,220 @@
+#include "engine/job_graph.h"
+#include "engine/atomic.h"
+#include "engine/log.h"
+#include "engine/os.h"
+#include "engine/profiler.h"
+
+
+namespace Lumix
+{
+
+
+namespace jobs
+{
+
+
+Graph::Graph(IAllocator& allocator)
+	: m_allocator(allocator)
+	, m_nodes(allocator)
+	, m_edges(allocator)
+	, m_links(allocator)
+	, m_roots(allocator)
+{}
+
+
+Graph::NodeHandle Graph::addNode(const char* name_literal, void* data, void (*task)(void*), Priority priority, u8 worker_index)
+{
+	ASSERT(m_running_count == 0);
+	m_is_valid = false;
+	m_has_finished_run = false;
+	Node& node = m_nodes.emplace();
+	node.name = name_literal;
+	node.data = data;
+	node.task = task;
+	node.graph = this;
+	node.successors_offset = 0;
+	node.successors_count = 0;
+	node.predecessors_offset = 0;
+	node.predecessors_count = 0;
+	node.pending = 0;
+	node.start = 0;
+	node.end = 0;
+	node.priority = priority;
+	node.worker_index = worker_index;
+	node.is_critical = false;
+	return m_nodes.size() - 1;
+}
+
+
+void Graph::addEdge(NodeHandle from, NodeHandle to)
+{
+	ASSERT(m_running_count == 0);
+	ASSERT(from < (u32)m_nodes.size() && to < (u32)m_nodes.size());
+	m_is_valid = false;
+	m_has_finished_run = false;
+	m_edges.push({from, to});
+}
+
+
+void Graph::clear()
+{
+	ASSERT(m_running_count == 0);
+	m_nodes.clear();
+	m_edges.clear();
+	m_links.clear();
+	m_roots.clear();
+	m_is_valid = false;
+	m_has_finished_run = false;
+	m_critical_path_duration = 0;
+}
+
+
+bool Graph::validate()
+{
+	for (Node& node : m_nodes) {
+		node.successors_count = 0;
+		node.predecessors_count = 0;
+	}
+	for (const Edge& edge : m_edges) {
+		if (edge.from == edge.to) {
+			logError("Job graph node ", m_nodes[edge.from].name, " depends on itself");
+			return false;
+		}
+		++m_nodes[edge.from].successors_count;
+		++m_nodes[edge.to].predecessors_count;
+	}
+
+	// flatten edges, so run does not have to touch m_edges
+	u32 offset = 0;
+	for (Node& node : m_nodes) {
+		node.successors_offset = offset;
+		offset += node.successors_count;
+		node.predecessors_offset = offset;
+		offset += node.predecessors_count;
+		node.successors_count = 0;
+		node.predecessors_count = 0;
+	}
+	m_links.resize(offset);
+	for (const Edge& edge : m_edges) {
+		Node& from = m_nodes[edge.from];
+		Node& to = m_nodes[edge.to];
+		m_links[from.successors_offset + from.successors_count] = edge.to;
+		++from.successors_count;
+		m_links[to.predecessors_offset + to.predecessors_count] = edge.from;
+		++to.predecessors_count;
+	}
+
+	m_roots.clear();
+	for (u32 i = 0, c = m_nodes.size(); i < c; ++i) {
+		if (m_nodes[i].predecessors_count == 0) m_roots.push(i);
+	}
+
+	// Kahn's algorithm, if it can't visit all nodes there's a cycle
+	for (Node& node : m_nodes) node.pending = node.predecessors_count;
+	Array<NodeHandle> stack(m_allocator);
+	for (NodeHandle root : m_roots) stack.push(root);
+	u32 visited = 0;
+	while (!stack.empty()) {
+		const Node& node = m_nodes[stack.back()];
+		stack.pop();
+		++visited;
+		for (u32 i = 0; i < node.successors_count; ++i) {
+			const NodeHandle succ = m_links[node.successors_offset + i];
+			--m_nodes[succ].pending;
+			if (m_nodes[succ].pending == 0) stack.push(succ);
+		}
+	}
+	if (visited != (u32)m_nodes.size()) {
+		logError("Job graph contains a cycle");
+		return false;
+	}
+
+	m_is_valid = true;
+	return true;
+}
+
+
+void Graph::updateCriticalPath()
+{
+	for (Node& node : m_nodes) node.is_critical = false;
+	if (m_nodes.empty()) return;
+
+	// walk back from the node which finished last, always through the predecessor which finished last
+	Node* node = &m_nodes[0];
+	for (Node& n : m_nodes) {
+		if (n.end > node->end) node = &n;
+	}
+	const u64 end = node->end;
+	for (;;) {
+		node->is_critical = true;
+		if (node->predecessors_count == 0) break;
+		Node* pred = &m_nodes[m_links[node->predecessors_offset]];
+		for (u32 i = 1; i < node->predecessors_count; ++i) {
+			Node& n = m_nodes[m_links[node->predecessors_offset + i]];
+			if (n.end > pred->end) pred = &n;
+		}
+		node = pred;
+	}
+	m_critical_path_duration = float((end - node->start) / double(os::Timer::getFrequency()));
+}
+
+
+void Graph::spawn(Node& node)
+{
+	atomicIncrement(&m_running_count);
+	runEx(&node, &execute, &m_signal, INVALID_HANDLE, node.worker_index, node.priority);
+}
+
+
+void Graph::execute(void* data)
+{
+	Node& node = *(Node*)data;
+	Graph& graph = *node.graph;
+
+	profiler::beginBlock(node.name);
+	if (node.is_critical) profiler::blockColor(0xff, 0, 0);
+	profiler::link(graph.m_profiler_link);
+	node.start = os::Timer::getRawTimestamp();
+	node.task(node.data);
+	node.end = os::Timer::getRawTimestamp();
+	profiler::endBlock();
+
+	for (u32 i = 0; i < node.successors_count; ++i) {
+		Node& succ = graph.m_nodes[graph.m_links[node.successors_offset + i]];
+		if (atomicDecrement(&succ.pending) == 0) graph.spawn(succ);
+	}
+	// successors are spawned before this, so the count can't reach zero while the graph is still running
+	if (atomicDecrement(&graph.m_running_count) == 0) graph.m_has_finished_run = true;
+}
+
+
+void Graph::run(SignalHandle* on_finish)
+{
+	ASSERT(m_is_valid);
+	ASSERT(m_running_count == 0);
+	if (m_has_finished_run) {
+		updateCriticalPath();
+		profiler::pushInt("critical path (us)", int(m_critical_path_duration * 1e6f));
+	}
+	m_has_finished_run = false;
+	if (m_nodes.empty()) return;
+
+	m_profiler_link = profiler::createNewLinkID();
+	for (Node& node : m_nodes) node.pending = node.predecessors_count;
+
+	// keep the signal alive while spawning, nodes use m_signal to spawn their successors
+	incSignal(on_finish);
+	m_signal = *on_finish;
+	atomicIncrement(&m_running_count);
+	for (NodeHandle root : m_roots) {
+		spawn(m_nodes[root]);
+	}
+	if (atomicDecrement(&m_running_count) == 0) m_has_finished_run = true;
+	decSignal(m_signal);
+}
+
+
+} // namespace jobs
+
+
+} // namespace Lumix
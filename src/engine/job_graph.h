@@ -0,0 +1,86 @@
+#pragma once
+
+
+#include "engine/array.h"
+#include "engine/job_system.h"
+
+
+namespace Lumix
+{
+
+
+namespace jobs
+{
+
+
+// dependency graph recorded once and replayed every frame
+// nodes are run as jobs once all their predecessors finished
+struct LUMIX_ENGINE_API Graph
+{
+	using NodeHandle = u32;
+
+	explicit Graph(IAllocator& allocator);
+	Graph(const Graph& rhs) = delete;
+	void operator=(const Graph& rhs) = delete;
+
+	// name must be a literal, it's used in profiler
+	NodeHandle addNode(const char* name_literal, void* data, void (*task)(void*), Priority priority = Priority::NORMAL, u8 worker_index = ANY_WORKER);
+	// `to` runs after `from` finishes
+	void addEdge(NodeHandle from, NodeHandle to);
+	// must be called after nodes and edges are added, fails if there's a cycle
+	bool validate();
+	// on_finish is signaled when all nodes finish, graph must not be modified or run again before that
+	void run(SignalHandle* on_finish);
+	void clear();
+
+	// critical path of the last finished run, nodes on it are highlighted in profiler
+	bool isOnCriticalPath(NodeHandle node) const { return m_nodes[node].is_critical; }
+	// in seconds
+	float getCriticalPathDuration() const { return m_critical_path_duration; }
+
+private:
+	struct Node {
+		const char* name;
+		void* data;
+		void (*task)(void*);
+		Graph* graph;
+		u32 successors_offset;
+		u32 successors_count;
+		u32 predecessors_offset;
+		u32 predecessors_count;
+		volatile i32 pending;
+		u64 start;
+		u64 end;
+		Priority priority;
+		u8 worker_index;
+		bool is_critical;
+	};
+
+	struct Edge {
+		NodeHandle from;
+		NodeHandle to;
+	};
+
+	static void execute(void* data);
+	void spawn(Node& node);
+	void updateCriticalPath();
+
+	IAllocator& m_allocator;
+	Array<Node> m_nodes;
+	Array<Edge> m_edges;
+	// successors and predecessors of all nodes, see Node::*_offset
+	Array<NodeHandle> m_links;
+	Array<NodeHandle> m_roots;
+	SignalHandle m_signal = INVALID_HANDLE;
+	volatile i32 m_running_count = 0;
+	i64 m_profiler_link = 0;
+	float m_critical_path_duration = 0;
+	bool m_is_valid = false;
+	bool m_has_finished_run = false;
+};
+
+
+} // namespace jobs
+
+
+} // namespace Lumix
@@ -20,6 +20,12 @@ enum {
 	HANDLE_GENERATION_MASK = 0xffFF0000 
 };
 
+enum {
+	SIGNALS_PAGE_SIZE = 4096,
+	// handle has only 16 bits for id
+	MAX_SIGNALS_PAGES = (HANDLE_ID_MASK + 1) / SIGNALS_PAGE_SIZE
+};
+
 
 struct Job
 {
@@ -28,12 +34,69 @@ struct Job
 	SignalHandle dec_on_finish;
 	SignalHandle precondition;
 	u8 worker_index;
+	Priority priority;
+};
+
+
+// Chase-Lev deque, only the owning worker pushes and pops at the bottom, other workers steal from the top
+struct WorkStealingQueue {
+	enum { CAPACITY = 4096 };
+
+	// owner only, returns false if the queue is full
+	bool push(const Job& job) {
+		const i64 b = m_bottom;
+		const i64 t = m_top;
+		if (b - t >= CAPACITY) return false;
+
+		m_jobs[b & (CAPACITY - 1)] = job;
+		memoryBarrier();
+		m_bottom = b + 1;
+		return true;
+	}
+
+	// owner only
+	bool pop(Job& job) {
+		const i64 b = m_bottom - 1;
+		m_bottom = b;
+		memoryBarrier();
+		const i64 t = m_top;
+		if (t > b) {
+			m_bottom = b + 1;
+			return false;
+		}
+
+		job = m_jobs[b & (CAPACITY - 1)];
+		if (t != b) return true;
+
+		// last job, race with thieves
+		const bool res = compareAndExchange64(&m_top, t + 1, t);
+		m_bottom = b + 1;
+		return res;
+	}
+
+	// any thread
+	bool steal(Job& job) {
+		const i64 t = m_top;
+		memoryBarrier();
+		const i64 b = m_bottom;
+		if (t >= b) return false;
+
+		job = m_jobs[t & (CAPACITY - 1)];
+		return compareAndExchange64(&m_top, t + 1, t);
+	}
+
+	bool empty() const { return m_bottom <= m_top; }
+	i32 size() const { return i32(m_bottom - m_top); }
+
+	alignas(64) volatile i64 m_top = 0;
+	alignas(64) volatile i64 m_bottom = 0;
+	alignas(64) Job m_jobs[CAPACITY];
 };
 
 
 struct Signal {
-	volatile int value;
-	u32 generation;
+	volatile i32 value;
+	volatile u32 generation;
 	Job next_job;
 	SignalHandle sibling;
 };
@@ -61,28 +124,64 @@ struct System
 		: m_allocator(allocator)
 		, m_workers(allocator)
 		, m_job_queue(allocator)
+		, m_critical_job_queue(allocator)
+		, m_background_job_queue(allocator)
 		, m_ready_fibers(allocator)
-		, m_signals_pool(allocator)
 		, m_free_queue(allocator)
 		, m_free_fibers(allocator)
 		, m_backup_workers(allocator)
+		, m_sleeping_workers(allocator)
 	{
-		m_signals_pool.resize(4096);
-		m_free_queue.resize(4096);
-		for(int i = 0; i < 4096; ++i) {
-			m_free_queue[i] = i;
-			m_signals_pool[i].sibling = jobs::INVALID_HANDLE;
-			m_signals_pool[i].generation = 0;
+		addSignalsPage();
+	}
+
+
+	~System() {
+		for (u32 i = 0; i < m_signals_pages_count; ++i) {
+			m_allocator.deallocate_aligned(m_signals_pages[i]);
 		}
 	}
 
 
+	// m_sync must be locked
+	bool addSignalsPage() {
+		if (m_signals_pages_count == MAX_SIGNALS_PAGES) return false;
+
+		Signal* page = (Signal*)m_allocator.allocate_aligned(sizeof(Signal) * SIGNALS_PAGE_SIZE, alignof(Signal));
+		const u32 first_id = m_signals_pages_count * SIGNALS_PAGE_SIZE;
+		m_free_queue.reserve(first_id + SIGNALS_PAGE_SIZE);
+		// push in reverse so ids are allocated in ascending order
+		for (u32 i = SIGNALS_PAGE_SIZE - 1; i != 0xffFFffFF; --i) {
+			Signal* signal = new (NewPlaceholder(), page + i) Signal;
+			signal->value = 0;
+			signal->generation = 0;
+			signal->sibling = jobs::INVALID_HANDLE;
+			m_free_queue.push(first_id + i);
+		}
+		// pages are never moved nor freed while the system runs, so readers do not need a lock
+		m_signals_pages[m_signals_pages_count] = page;
+		memoryBarrier();
+		++m_signals_pages_count;
+		return true;
+	}
+
+
 	Mutex m_sync;
 	Mutex m_job_queue_sync;
 	Array<WorkerTask*> m_workers;
 	Array<WorkerTask*> m_backup_workers;
+	Array<WorkerTask*> m_sleeping_workers;
+	volatile i32 m_sleeping_count = 0;
+	volatile i32 m_searching_count = 0;
+	// jobs pushed from non-worker threads and overflow of full worker queues
 	Array<Job> m_job_queue;
-	Array<Signal> m_signals_pool;
+	Array<Job> m_critical_job_queue;
+	// background jobs are coarse, so they do not need lock-free queues
+	Array<Job> m_background_job_queue;
+	u8 m_background_workers_limit = 1;
+	volatile i32 m_background_jobs_running = 0;
+	Signal* m_signals_pages[MAX_SIGNALS_PAGES] = {};
+	volatile u32 m_signals_pages_count = 0;
 	FiberDecl m_fiber_pool[512];
 	Array<FiberDecl*> m_free_fibers;
 	Array<FiberDecl*> m_ready_fibers;
@@ -145,20 +244,45 @@ struct WorkerTask : Thread
 	FiberDecl* m_current_fiber = nullptr;
 	Fiber::Handle m_primary_fiber;
 	System& m_system;
+	// jobs pinned to this worker
 	Array<Job> m_job_queue;
 	Array<FiberDecl*> m_ready_fibers;
+	// indexed by Priority, background jobs are never in these
+	WorkStealingQueue m_work_queues[2];
 	u8 m_worker_index;
+	u32 m_steal_offset = 0;
+	// written only by this worker, see endFrame
+	struct {
+		u32 jobs_executed = 0;
+		u32 fiber_switches = 0;
+		u64 idle_ticks = 0;
+		u64 wait_ticks = 0;
+	} m_counters, m_last_counters;
+	volatile i32 m_max_queue_depth = 0;
+	WorkerStats m_frame_stats = {};
+	bool m_is_searching = false;
 	bool m_is_enabled = false;
 	bool m_is_backup = false;
 };
 
 
+static LUMIX_FORCE_INLINE Signal& getSignal(SignalHandle handle)
+{
+	const u32 id = handle & HANDLE_ID_MASK;
+	ASSERT(id < g_system->m_signals_pages_count * SIGNALS_PAGE_SIZE);
+	return g_system->m_signals_pages[id / SIGNALS_PAGE_SIZE][id % SIGNALS_PAGE_SIZE];
+}
+
+
+// m_sync must be locked
 static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
 {
-	LUMIX_FATAL(!g_system->m_free_queue.empty());
+	if (g_system->m_free_queue.empty()) {
+		LUMIX_FATAL(g_system->addSignalsPage());
+	}
 
 	const u32 handle = g_system->m_free_queue.back();
-	Signal& w = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
+	Signal& w = getSignal(handle);
 	w.value = 1;
 	w.sibling = jobs::INVALID_HANDLE;
 	w.next_job.task = nullptr;
@@ -168,36 +292,85 @@ static LUMIX_FORCE_INLINE SignalHandle allocateSignal()
 }
 
 
+// m_job_queue_sync must be locked
+static void wakeupIdleWorkerLocked()
+{
+	// a searching worker is going to find the job, no need to wake another one
+	if (g_system->m_searching_count > 0) return;
+	if (g_system->m_sleeping_workers.empty()) return;
+
+	WorkerTask* worker = g_system->m_sleeping_workers.back();
+	g_system->m_sleeping_workers.pop();
+	atomicDecrement(&g_system->m_sleeping_count);
+	worker->m_is_searching = true;
+	atomicIncrement(&g_system->m_searching_count);
+	worker->wakeup();
+}
+
+
+static void wakeupIdleWorker()
+{
+	// pairs with atomics in manage(), so either we see the sleeping worker or it sees our job
+	memoryBarrier();
+	if (g_system->m_searching_count > 0 || g_system->m_sleeping_count == 0) return;
+
+	MutexGuard lock(g_system->m_job_queue_sync);
+	wakeupIdleWorkerLocked();
+}
+
+
 static void pushJob(const Job& job)
 {
 	if (job.worker_index != ANY_WORKER) {
 		WorkerTask* worker = g_system->m_workers[job.worker_index % g_system->m_workers.size()];
+		MutexGuard lock(g_system->m_job_queue_sync);
 		worker->m_job_queue.push(job);
 		worker->wakeup();
 		return;
 	}
-	g_system->m_job_queue.push(job);
-	for (WorkerTask* worker : g_system->m_workers) {
-		worker->wakeup();
+
+	if (job.priority == Priority::BACKGROUND) {
+		MutexGuard lock(g_system->m_job_queue_sync);
+		g_system->m_background_job_queue.push(job);
+		if (g_system->m_background_jobs_running < g_system->m_background_workers_limit) {
+			wakeupIdleWorkerLocked();
+		}
+		return;
+	}
+
+	WorkerTask* worker = getWorker();
+	if (worker && !worker->m_is_backup && worker->m_work_queues[(u8)job.priority].push(job)) {
+		const i32 depth = worker->m_work_queues[(u8)Priority::CRITICAL].size() + worker->m_work_queues[(u8)Priority::NORMAL].size();
+		if (depth > worker->m_max_queue_depth) worker->m_max_queue_depth = depth;
+		wakeupIdleWorker();
+		return;
+	}
+
+	MutexGuard lock(g_system->m_job_queue_sync);
+	if (job.priority == Priority::CRITICAL) {
+		g_system->m_critical_job_queue.push(job);
+	}
+	else {
+		g_system->m_job_queue.push(job);
 	}
+	wakeupIdleWorkerLocked();
 }
 
 
 void trigger(SignalHandle handle)
 {
-	LUMIX_FATAL((handle & HANDLE_ID_MASK) < 4096);
+	LUMIX_FATAL((handle & HANDLE_ID_MASK) < g_system->m_signals_pages_count * SIGNALS_PAGE_SIZE);
+
+	// only the last decrement needs the lock
+	Signal& counter = getSignal(handle);
+	if (atomicDecrement(&counter.value) > 0) return;
 
 	MutexGuard lock(g_system->m_sync);
 	
-	Signal& counter = g_system->m_signals_pool[handle & HANDLE_ID_MASK];
-	--counter.value;
-	if (counter.value > 0) return;
-
 	SignalHandle iter = handle;
 	while (isValid(iter)) {
-		Signal& signal = g_system->m_signals_pool[iter & HANDLE_ID_MASK];
+		Signal& signal = getSignal(iter);
 		if(signal.next_job.task) {
-			MutexGuard queue_lock(g_system->m_job_queue_sync);
 			pushJob(signal.next_job);
 		}
 		signal.generation = (((signal.generation >> 16) + 1) & 0xffFF) << 16;
@@ -208,18 +381,30 @@ void trigger(SignalHandle handle)
 }
 
 
-static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle, bool lock)
+static LUMIX_FORCE_INLINE bool isSignalZero(SignalHandle handle)
 {
 	if (!isValid(handle)) return true;
 
 	const u32 gen = handle & HANDLE_GENERATION_MASK;
-	const u32 id = handle & HANDLE_ID_MASK;
-	
-	if (lock) g_system->m_sync.enter();
-	Signal& counter = g_system->m_signals_pool[id];
-	bool is_zero = counter.generation != gen || counter.value == 0;
-	if (lock) g_system->m_sync.exit();
-	return is_zero;
+	const Signal& counter = getSignal(handle);
+	// value must be read before generation, a reused signal has new generation
+	const i32 value = counter.value;
+	return counter.generation != gen || value == 0;
+}
+
+
+// increments signal if it's not zero yet, otherwise allocates a new one; m_sync must be locked
+static LUMIX_FORCE_INLINE SignalHandle incSignalLocked(SignalHandle handle)
+{
+	if (isValid(handle)) {
+		Signal& counter = getSignal(handle);
+		for (;;) {
+			const i32 value = counter.value;
+			if (value == 0 || counter.generation != (handle & HANDLE_GENERATION_MASK)) break;
+			if (compareAndExchange(&counter.value, value + 1, value)) return handle;
+		}
+	}
+	return allocateSignal();
 }
 
 
@@ -228,34 +413,29 @@ static LUMIX_FORCE_INLINE void runInternal(void* data
 	, SignalHandle precondition
 	, bool do_lock
 	, SignalHandle* on_finish
-	, u8 worker_index)
+	, u8 worker_index
+	, Priority priority)
 {
 	Job j;
 	j.data = data;
 	j.task = task;
 	j.worker_index = worker_index != ANY_WORKER ? worker_index % getWorkersCount() : worker_index;
 	j.precondition = precondition;
+	// pinned jobs bypass the priority queues, so they must not count as background
+	j.priority = worker_index != ANY_WORKER ? Priority::NORMAL : priority;
 
 	if (do_lock) g_system->m_sync.enter();
-	j.dec_on_finish = [&]() -> SignalHandle {
-		if (!on_finish) return INVALID_HANDLE;
-		if (isValid(*on_finish) && !isSignalZero(*on_finish, false)) {
-			++g_system->m_signals_pool[*on_finish & HANDLE_ID_MASK].value;
-			return *on_finish;
-		}
-		return allocateSignal();
-	}();
+	j.dec_on_finish = on_finish ? incSignalLocked(*on_finish) : INVALID_HANDLE;
 	if (on_finish) *on_finish = j.dec_on_finish;
 
-	if (!isValid(precondition) || isSignalZero(precondition, false)) {
-		MutexGuard lock(g_system->m_job_queue_sync);
+	if (!isValid(precondition) || isSignalZero(precondition)) {
 		pushJob(j);
 	}
 	else {
-		Signal& counter = g_system->m_signals_pool[precondition & HANDLE_ID_MASK];
+		Signal& counter = getSignal(precondition);
 		if(counter.next_job.task) {
 			const SignalHandle ch = allocateSignal();
-			Signal& c = g_system->m_signals_pool[ch & HANDLE_ID_MASK];
+			Signal& c = getSignal(ch);
 			c.next_job = j;
 			c.sibling = counter.sibling;
 			counter.sibling = ch;
@@ -295,17 +475,76 @@ void enableBackupWorker(bool enable)
 
 
 
+WorkerStats getWorkerStats(u8 worker_index)
+{
+	MutexGuard lock(g_system->m_job_queue_sync);
+	if (worker_index >= g_system->m_workers.size()) return {};
+	return g_system->m_workers[worker_index]->m_frame_stats;
+}
+
+
+u32 getFreeSignalsCount()
+{
+	MutexGuard lock(g_system->m_sync);
+	return g_system->m_free_queue.size() + (MAX_SIGNALS_PAGES - g_system->m_signals_pages_count) * SIGNALS_PAGE_SIZE;
+}
+
+
+u32 getFreeFibersCount()
+{
+	MutexGuard lock(g_system->m_sync);
+	return g_system->m_free_fibers.size();
+}
+
+
+void endFrame()
+{
+	PROFILE_FUNCTION();
+	const float to_seconds = 1.f / os::Timer::getFrequency();
+	{
+		MutexGuard lock(g_system->m_job_queue_sync);
+		for (WorkerTask* worker : g_system->m_workers) {
+			// counters are written by the worker without a lock, we only read them and diff with previous frame
+			const auto counters = worker->m_counters;
+			WorkerStats& stats = worker->m_frame_stats;
+			stats.jobs_executed = counters.jobs_executed - worker->m_last_counters.jobs_executed;
+			stats.fiber_switches = counters.fiber_switches - worker->m_last_counters.fiber_switches;
+			stats.idle_time = (counters.idle_ticks - worker->m_last_counters.idle_ticks) * to_seconds;
+			stats.wait_time = (counters.wait_ticks - worker->m_last_counters.wait_ticks) * to_seconds;
+			stats.max_queue_depth = worker->m_max_queue_depth;
+			worker->m_max_queue_depth = 0;
+			worker->m_last_counters = counters;
+
+			// one block per worker, so the keys do not repeat within a block
+			profiler::beginBlock("worker stats");
+			profiler::pushInt("worker", worker->m_worker_index);
+			profiler::pushInt("jobs executed", stats.jobs_executed);
+			profiler::pushInt("fiber switches", stats.fiber_switches);
+			profiler::pushInt("idle (us)", int(stats.idle_time * 1e6f));
+			profiler::pushInt("waiting (us)", int(stats.wait_time * 1e6f));
+			profiler::pushInt("max queue depth", stats.max_queue_depth);
+			profiler::endBlock();
+		}
+	}
+	profiler::pushInt("free signals", getFreeSignalsCount());
+	profiler::pushInt("free fibers", getFreeFibersCount());
+}
+
+
+void setBackgroundWorkersLimit(u8 count)
+{
+	MutexGuard lock(g_system->m_job_queue_sync);
+	// at least one, otherwise waiting on a background job would never finish
+	g_system->m_background_workers_limit = maximum(count, (u8)1);
+	wakeupIdleWorkerLocked();
+}
+
+
 void incSignal(SignalHandle* signal)
 {
 	ASSERT(signal);
 	MutexGuard lock(g_system->m_sync);
-	
-	if (isValid(*signal) && !isSignalZero(*signal, false)) {
-		++g_system->m_signals_pool[*signal & HANDLE_ID_MASK].value;
-	}
-	else {
-		*signal = allocateSignal();
-	}
+	*signal = incSignalLocked(*signal);
 }
 
 
@@ -317,13 +556,107 @@ void decSignal(SignalHandle signal)
 
 void run(void* data, void(*task)(void*), SignalHandle* on_finished)
 {
-	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER);
+	runInternal(data, task, INVALID_HANDLE, true, on_finished, ANY_WORKER, Priority::NORMAL);
+}
+
+
+void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index, Priority priority)
+{
+	runInternal(data, task, precondition, true, on_finished, worker_index, priority);
+}
+
+
+static bool steal(WorkerTask& worker, Priority priority, Job& job)
+{
+	// workers are still being created during init
+	const u32 count = g_system->m_workers.size();
+	if (count == 0) return false;
+
+	const u32 offset = worker.m_steal_offset;
+	worker.m_steal_offset = (offset + 1) % count;
+	for (u32 i = 0; i < count; ++i) {
+		WorkerTask* victim = g_system->m_workers[(offset + i) % count];
+		if (victim == &worker) continue;
+		if (victim->m_work_queues[(u8)priority].steal(job)) return true;
+	}
+	return false;
+}
+
+
+static bool popBackgroundJob(Job& job)
+{
+	if (g_system->m_background_job_queue.empty()) return false;
+	if (g_system->m_background_jobs_running >= g_system->m_background_workers_limit) return false;
+
+	MutexGuard lock(g_system->m_job_queue_sync);
+	if (g_system->m_background_job_queue.empty()) return false;
+	if (g_system->m_background_jobs_running >= g_system->m_background_workers_limit) return false;
+
+	job = g_system->m_background_job_queue.back();
+	g_system->m_background_job_queue.pop();
+	atomicIncrement(&g_system->m_background_jobs_running);
+	return true;
+}
+
+
+static bool popWork(WorkerTask& worker, FiberDecl*& fiber, Job& job)
+{
+	// pinned jobs, resumed fibers and jobs from non-worker threads are rare, so check them without the lock first
+	if (!worker.m_ready_fibers.empty() || !worker.m_job_queue.empty() || !g_system->m_ready_fibers.empty() || !g_system->m_critical_job_queue.empty()) {
+		MutexGuard lock(g_system->m_job_queue_sync);
+		if (!worker.m_ready_fibers.empty()) {
+			fiber = worker.m_ready_fibers.back();
+			worker.m_ready_fibers.pop();
+			return true;
+		}
+		if (!worker.m_job_queue.empty()) {
+			job = worker.m_job_queue.back();
+			worker.m_job_queue.pop();
+			return true;
+		}
+		if (!g_system->m_ready_fibers.empty()) {
+			fiber = g_system->m_ready_fibers.back();
+			g_system->m_ready_fibers.pop();
+			return true;
+		}
+		if (!g_system->m_critical_job_queue.empty()) {
+			job = g_system->m_critical_job_queue.back();
+			g_system->m_critical_job_queue.pop();
+			return true;
+		}
+	}
+
+	if (worker.m_work_queues[(u8)Priority::CRITICAL].pop(job)) return true;
+	if (steal(worker, Priority::CRITICAL, job)) return true;
+
+	if (!g_system->m_job_queue.empty()) {
+		MutexGuard lock(g_system->m_job_queue_sync);
+		if (!g_system->m_job_queue.empty()) {
+			job = g_system->m_job_queue.back();
+			g_system->m_job_queue.pop();
+			return true;
+		}
+	}
+
+	if (worker.m_work_queues[(u8)Priority::NORMAL].pop(job)) return true;
+	if (steal(worker, Priority::NORMAL, job)) return true;
+
+	return popBackgroundJob(job);
 }
 
 
-void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHandle precondition, u8 worker_index)
+// m_job_queue_sync must be locked
+static bool hasWork(const WorkerTask& worker)
 {
-	runInternal(data, task, precondition, true, on_finished, worker_index);
+	if (!worker.m_ready_fibers.empty() || !worker.m_job_queue.empty()) return true;
+	if (!g_system->m_ready_fibers.empty() || !g_system->m_job_queue.empty() || !g_system->m_critical_job_queue.empty()) return true;
+	if (!g_system->m_background_job_queue.empty() && g_system->m_background_jobs_running < g_system->m_background_workers_limit) return true;
+	for (const WorkerTask* w : g_system->m_workers) {
+		for (const WorkStealingQueue& queue : w->m_work_queues) {
+			if (!queue.empty()) return true;
+		}
+	}
+	return false;
 }
 
 
@@ -346,39 +679,47 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 			while (!worker->m_is_enabled && !worker->m_finished) {
 				PROFILE_BLOCK("disabled");
 				profiler::blockColor(0xff, 0, 0xff);
+				const u64 sleep_start = os::Timer::getRawTimestamp();
 				worker->sleep(g_system->m_sync);
+				worker->m_counters.idle_ticks += os::Timer::getRawTimestamp() - sleep_start;
 			}
 		}
 
 		FiberDecl* fiber = nullptr;
 		Job job;
 		while (!worker->m_finished) {
-			MutexGuard lock(g_system->m_job_queue_sync);
-
-			if (!worker->m_ready_fibers.empty()) {
-				fiber = worker->m_ready_fibers.back();
-				worker->m_ready_fibers.pop();
+			if (popWork(*worker, fiber, job)) {
+				if (worker->m_is_searching) {
+					worker->m_is_searching = false;
+					// we were the last one looking for work, there might be more
+					if (atomicDecrement(&g_system->m_searching_count) == 0) wakeupIdleWorker();
+				}
 				break;
 			}
-			if (!worker->m_job_queue.empty()) {
-				job = worker->m_job_queue.back();
-				worker->m_job_queue.pop();
-				break;
+
+			MutexGuard lock(g_system->m_job_queue_sync);
+			if (worker->m_is_searching) {
+				worker->m_is_searching = false;
+				atomicDecrement(&g_system->m_searching_count);
 			}
-			if (!g_system->m_ready_fibers.empty()) {
-				fiber = g_system->m_ready_fibers.back();
-				g_system->m_ready_fibers.pop();
-				break;
+			g_system->m_sleeping_workers.push(worker);
+			atomicIncrement(&g_system->m_sleeping_count);
+			if (!hasWork(*worker) && !worker->m_finished) {
+				PROFILE_BLOCK("sleeping");
+				profiler::blockColor(0xff, 0, 0xff);
+				const u64 sleep_start = os::Timer::getRawTimestamp();
+				worker->sleep(g_system->m_job_queue_sync);
+				worker->m_counters.idle_ticks += os::Timer::getRawTimestamp() - sleep_start;
 			}
-			if(!g_system->m_job_queue.empty()) {
-				job = g_system->m_job_queue.back();
-				g_system->m_job_queue.pop();
-				break;
+			const int idx = g_system->m_sleeping_workers.indexOf(worker);
+			if (idx >= 0) {
+				g_system->m_sleeping_workers.swapAndPop(idx);
+				atomicDecrement(&g_system->m_sleeping_count);
+			}
+			if (!worker->m_is_searching) {
+				worker->m_is_searching = true;
+				atomicIncrement(&g_system->m_searching_count);
 			}
-
-			PROFILE_BLOCK("sleeping");
-			profiler::blockColor(0xff, 0, 0xff);
-			worker->sleep(g_system->m_job_queue_sync);
 		}
 		if (worker->m_finished) break;
 
@@ -389,6 +730,7 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 			g_system->m_sync.enter();
             LUMIX_FATAL(!this_fiber->current_job.task);
 			g_system->m_free_fibers.push(this_fiber);
+			++worker->m_counters.fiber_switches;
 			Fiber::switchTo(&this_fiber->fiber, fiber->fiber);
 			g_system->m_sync.exit();
 
@@ -406,10 +748,15 @@ void runEx(void* data, void(*task)(void*), SignalHandle* on_finished, SignalHand
 			this_fiber->current_job = job;
 			job.task(job.data);
             this_fiber->current_job.task = nullptr;
+			worker = getWorker();
+			++worker->m_counters.jobs_executed;
+			if (job.priority == Priority::BACKGROUND) {
+				atomicDecrement(&g_system->m_background_jobs_running);
+				if (!g_system->m_background_job_queue.empty()) wakeupIdleWorker();
+			}
 			if (isValid(job.dec_on_finish)) {
 				trigger(job.dec_on_finish);
 			}
-			worker = getWorker();
 			profiler::endBlock();
 			profiler::beginBlock("job management");
 			profiler::blockColor(0, 0, 0xff);
@@ -436,8 +783,11 @@ bool init(u8 workers_count, IAllocator& allocator)
 	}
 
 	int count = maximum(1, int(workers_count));
+	// running workers read m_workers, so it must not be reallocated
+	g_system->m_workers.reserve(count);
 	for (int i = 0; i < count; ++i) {
-		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, i < 64 ? u64(1) << i : 0);
+		WorkerTask* task = LUMIX_NEW(allocator, WorkerTask)(*g_system, (u8)i);
+		task->m_steal_offset = i + 1;
 		if (task->create("Worker", false)) {
 			task->m_is_enabled = true;
 			g_system->m_workers.push(task);
@@ -449,6 +799,8 @@ bool init(u8 workers_count, IAllocator& allocator)
 		}
 	}
 
+	g_system->m_background_workers_limit = (u8)maximum(1, g_system->m_workers.size() / 2);
+
 	return !g_system->m_workers.empty();
 }
 
@@ -479,16 +831,18 @@ void shutdown()
 	{
 		while (!task->isFinished()) task->wakeup();
 		task->destroy();
-		LUMIX_DELETE(allocator, task);
 	}
 
 	for (WorkerTask* task : g_system->m_workers)
 	{
 		while (!task->isFinished()) task->wakeup();
 		task->destroy();
-		LUMIX_DELETE(allocator, task);
 	}
 
+	// running workers steal from other workers' queues, so delete only after all of them are finished
+	for (Thread* task : g_system->m_backup_workers) LUMIX_DELETE(allocator, task);
+	for (WorkerTask* task : g_system->m_workers) LUMIX_DELETE(allocator, task);
+
 	for (FiberDecl& fiber : g_system->m_fiber_pool)
 	{
 		if(Fiber::isValid(fiber.fiber)) {
@@ -502,18 +856,17 @@ void shutdown()
 
 void wait(SignalHandle handle)
 {
-	g_system->m_sync.enter();
-	if (isSignalZero(handle, false)) {
-		g_system->m_sync.exit();
-		return;
-	}
+	if (isSignalZero(handle)) return;
 	
 	if (!getWorker()) {
-		while (!isSignalZero(handle, false)) {
-			g_system->m_sync.exit();
+		while (!isSignalZero(handle)) {
 			os::sleep(1);
-			g_system->m_sync.enter();
 		}
+		return;
+	}
+
+	g_system->m_sync.enter();
+	if (isSignalZero(handle)) {
 		g_system->m_sync.exit();
 		return;
 	}
@@ -526,16 +879,14 @@ void wait(SignalHandle handle)
 		FiberDecl* fiber = (FiberDecl*)data;
 		if (fiber->current_job.worker_index == ANY_WORKER) {
 			g_system->m_ready_fibers.push(fiber);
-			for (WorkerTask* worker : g_system->m_workers) {
-				worker->wakeup();
-			}
+			wakeupIdleWorkerLocked();
 		}
 		else {
 			WorkerTask* worker = g_system->m_workers[fiber->current_job.worker_index % g_system->m_workers.size()];
 			worker->m_ready_fibers.push(fiber);
 			worker->wakeup();
 		}
-	}, handle, false, nullptr, 0);
+	}, handle, false, nullptr, 0, Priority::NORMAL);
 	
 	const profiler::FiberSwitchData& switch_data = profiler::beginFiberWait(handle);
 	FiberDecl* new_fiber = g_system->m_free_fibers.back();
@@ -543,17 +894,21 @@ void wait(SignalHandle handle)
 	if (!Fiber::isValid(new_fiber->fiber)) {
 		new_fiber->fiber = Fiber::create(64 * 1024, manage, new_fiber);
 	}
+	// waiting background job does not count towards the limit, so it can't block other background jobs
+	const bool is_background = this_fiber->current_job.priority == Priority::BACKGROUND;
+	if (is_background) atomicDecrement(&g_system->m_background_jobs_running);
+	const u64 wait_start = os::Timer::getRawTimestamp();
 	getWorker()->m_current_fiber = new_fiber;
+	++getWorker()->m_counters.fiber_switches;
 	Fiber::switchTo(&this_fiber->fiber, new_fiber->fiber);
-	getWorker()->m_current_fiber = this_fiber;
+	WorkerTask* worker = getWorker();
+	worker->m_current_fiber = this_fiber;
+	worker->m_counters.wait_ticks += os::Timer::getRawTimestamp() - wait_start;
+	if (is_background) atomicIncrement(&g_system->m_background_jobs_running);
 	g_system->m_sync.exit();
 	profiler::endFiberWait(handle, switch_data);
 	
-	#ifdef LUMIX_DEBUG
-		g_system->m_sync.enter();
-		ASSERT(isSignalZero(handle, false));
-		g_system->m_sync.exit();
-	#endif
+	ASSERT(isSignalZero(handle));
 }
 
-} // namespace Lumix::jobs
\ No newline at end of file
+} // namespace Lumix::jobs
\ No newline at end of file
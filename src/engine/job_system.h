@@ -1,5 +1,6 @@
 #pragma once
 #include "lumix.h"
+#include "atomic.h"
 
 namespace Lumix {
 
@@ -11,35 +12,62 @@ using SignalHandle = u32;
 constexpr u8 ANY_WORKER = 0xff;
 constexpr u32 INVALID_HANDLE = 0xffFFffFF;
 
+// workers always take jobs from higher lanes first
+enum class Priority : u8 {
+	CRITICAL,
+	NORMAL,
+	// only limited number of background jobs run at once, see setBackgroundWorkersLimit
+	BACKGROUND
+};
+
+struct WorkerStats {
+	u32 jobs_executed;
+	u32 fiber_switches;
+	// the highest number of jobs in worker's queues
+	u32 max_queue_depth;
+	// in seconds
+	float idle_time;
+	float wait_time;
+};
+
 LUMIX_ENGINE_API bool init(u8 workers_count, IAllocator& allocator);
 LUMIX_ENGINE_API void shutdown();
 LUMIX_ENGINE_API u8 getWorkersCount();
 
 LUMIX_ENGINE_API void enableBackupWorker(bool enable);
+LUMIX_ENGINE_API void setBackgroundWorkersLimit(u8 count);
+
+// collects stats of the last frame and pushes them to profiler, call once per frame
+LUMIX_ENGINE_API void endFrame();
+// stats of the last frame
+LUMIX_ENGINE_API WorkerStats getWorkerStats(u8 worker_index);
+LUMIX_ENGINE_API u32 getFreeSignalsCount();
+LUMIX_ENGINE_API u32 getFreeFibersCount();
 
 LUMIX_ENGINE_API void incSignal(SignalHandle* signal);
 LUMIX_ENGINE_API void decSignal(SignalHandle signal);
 
 LUMIX_ENGINE_API void run(void* data, void(*task)(void*), SignalHandle* on_finish);
-LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index);
+// priority is ignored for jobs pinned to a worker
+LUMIX_ENGINE_API void runEx(void* data, void (*task)(void*), SignalHandle* on_finish, SignalHandle precondition, u8 worker_index, Priority priority = Priority::NORMAL);
 LUMIX_ENGINE_API void wait(SignalHandle waitable);
 
 
 template <typename F>
-void runOnWorkers(const F& f)
+void runOnWorkers(const F& f, Priority priority = Priority::NORMAL)
 {
 	SignalHandle signal = jobs::INVALID_HANDLE;
 	for(int i = 0, c = getWorkersCount(); i < c; ++i) {
-		jobs::run((void*)&f, [](void* data){
+		jobs::runEx((void*)&f, [](void* data){
 			(*(const F*)data)();
-		}, &signal);
+		}, &signal, INVALID_HANDLE, ANY_WORKER, priority);
 	}
 	wait(signal);
 }
 
 
 template <typename F>
-void forEach(i32 count, i32 step, const F& f)
+void forEach(i32 count, i32 step, const F& f, Priority priority = Priority::NORMAL)
 {
 	if (count == 0) return;
 	if (count <= step) {
@@ -57,7 +85,146 @@ void forEach(i32 count, i32 step, const F& f)
 			to = to > count ? count : to;
 			f(idx, to);
 		}
-	});
+	}, priority);
+}
+
+
+namespace detail {
+
+// splits off upper halves of the range as new jobs until it's small enough, so idle workers steal big chunks
+template <typename T, typename F, typename Combine>
+struct ParallelRange {
+	static void execute(void* data) {
+		ParallelRange& range = *(ParallelRange*)data;
+		ParallelRange children[32];
+		u32 children_count = 0;
+		SignalHandle signal = INVALID_HANDLE;
+		i32 to = range.to;
+		while (to - range.from > range.grain) {
+			const i32 mid = range.from + (to - range.from) / 2;
+			ParallelRange& child = children[children_count];
+			++children_count;
+			child.f = range.f;
+			child.combine = range.combine;
+			child.from = mid;
+			child.to = to;
+			child.grain = range.grain;
+			child.priority = range.priority;
+			runEx(&child, &execute, &signal, INVALID_HANDLE, ANY_WORKER, range.priority);
+			to = mid;
+		}
+		range.result = (*range.f)(range.from, to);
+		wait(signal);
+		// children are in descending order of their ranges
+		for (u32 i = children_count; i > 0; --i) {
+			range.result = (*range.combine)(range.result, children[i - 1].result);
+		}
+	}
+
+	const F* f;
+	const Combine* combine;
+	i32 from;
+	i32 to;
+	i32 grain;
+	Priority priority;
+	T result;
+};
+
+struct Empty {};
+
+template <typename T, typename F, typename Combine>
+T parallelRange(i32 count, i32 grain, const F& f, const Combine& combine, Priority priority)
+{
+	ParallelRange<T, F, Combine> range;
+	range.f = &f;
+	range.combine = &combine;
+	range.from = 0;
+	range.to = count;
+	range.grain = grain;
+	range.priority = priority;
+	ParallelRange<T, F, Combine>::execute(&range);
+	return range.result;
+}
+
+inline i32 defaultGrain(i32 count) {
+	// a few chunks per worker, so there's something to steal when some items take longer
+	const i32 grain = count / (getWorkersCount() * 4);
+	return grain < 1 ? 1 : grain;
+}
+
+} // namespace detail
+
+
+// f(from, to) processes items in [from, to), chunk size is picked automatically
+template <typename F>
+void parallelFor(i32 count, const F& f, Priority priority = Priority::NORMAL)
+{
+	if (count <= 0) return;
+	const i32 grain = detail::defaultGrain(count);
+	if (count <= grain) {
+		f(0, count);
+		return;
+	}
+
+	detail::parallelRange<detail::Empty>(count, grain, [&f](i32 from, i32 to){
+		f(from, to);
+		return detail::Empty();
+	}, [](detail::Empty, detail::Empty){ return detail::Empty(); }, priority);
+}
+
+
+// reduce(from, to) -> T reduces items in [from, to), combine(T, T) -> T merges results of adjacent ranges
+// combine must be associative, lower range is always the first argument
+template <typename T, typename Reduce, typename Combine>
+T parallelReduce(i32 count, T identity, const Reduce& reduce, const Combine& combine, Priority priority = Priority::NORMAL)
+{
+	if (count <= 0) return identity;
+	const i32 grain = detail::defaultGrain(count);
+	if (count <= grain) return combine(identity, reduce(0, count));
+
+	return combine(identity, detail::parallelRange<T>(count, grain, reduce, combine, priority));
+}
+
+
+// inclusive scan in two passes
+// reduce(from, to) -> T reduces items in [from, to)
+// scan(from, to, prefix) scans items in [from, to), prefix is the reduction of all items before `from`
+template <typename T, typename Reduce, typename Scan, typename Combine>
+void parallelScan(i32 count, T identity, const Reduce& reduce, const Scan& scan, const Combine& combine, Priority priority = Priority::NORMAL)
+{
+	if (count <= 0) return;
+	enum { MAX_BLOCKS = 64 };
+	i32 blocks_count = getWorkersCount() * 4;
+	blocks_count = blocks_count > MAX_BLOCKS ? MAX_BLOCKS : blocks_count;
+	blocks_count = blocks_count > count ? count : blocks_count;
+	if (blocks_count <= 1) {
+		scan(0, count, identity);
+		return;
+	}
+
+	const i32 block_size = (count + blocks_count - 1) / blocks_count;
+	blocks_count = (count + block_size - 1) / block_size;
+	T sums[MAX_BLOCKS];
+	parallelFor(blocks_count, [&](i32 from, i32 to){
+		for (i32 i = from; i < to; ++i) {
+			const i32 end = (i + 1) * block_size;
+			sums[i] = reduce(i * block_size, end > count ? count : end);
+		}
+	}, priority);
+
+	T prefix = identity;
+	for (i32 i = 0; i < blocks_count; ++i) {
+		const T tmp = sums[i];
+		sums[i] = prefix;
+		prefix = combine(prefix, tmp);
+	}
+
+	parallelFor(blocks_count, [&](i32 from, i32 to){
+		for (i32 i = from; i < to; ++i) {
+			const i32 end = (i + 1) * block_size;
+			scan(i * block_size, end > count ? count : end, sums[i]);
+		}
+	}, priority);
 }
 
 } // namespace jobs
@@ -4,6 +4,9 @@
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <execinfo.h>
 
 
 static bool g_is_crash_reporting_enabled = false;
@@ -41,19 +44,23 @@ struct StackNode
 	}
 
 	void* m_instruction;
-	StackNode* m_next;
-	StackNode* m_first_child;
+	StackNode* m_next = nullptr;
+	StackNode* m_first_child = nullptr;
 	StackNode* m_parent;
 };
 
 
 StackTree::StackTree()
 {
+	m_root = nullptr;
+	atomicIncrement(&s_instances);
 }
 
 
 StackTree::~StackTree()
 {
+	delete m_root;
+	atomicDecrement(&s_instances);
 }
 
 
@@ -64,36 +71,140 @@ void StackTree::refreshModuleList()
 
 int StackTree::getPath(StackNode* node, Span<StackNode*> output)
 {
-	return 0;
+	u32 i = 0;
+	while (i < output.length() && node)
+	{
+		output[i] = node;
+		i++;
+		node = node->m_parent;
+	}
+	return i;
 }
 
 
 StackNode* StackTree::getParent(StackNode* node)
 {
-	return nullptr;
+	return node ? node->m_parent : nullptr;
 }
 
 
 bool StackTree::getFunction(StackNode* node, Span<char> out, Ref<int> line)
 {
-	return false;
+	line = -1;
+	if (!node) return false;
+	return getFunction(node->m_instruction, out, line);
+}
+
+
+bool StackTree::getFunction(void* instruction, Span<char> out, Ref<int> line)
+{
+	line = -1;
+	Dl_info info;
+	if (!dladdr(instruction, &info)) return false;
+	if (info.dli_sname) {
+		int status;
+		char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+		copyString(out, status == 0 ? demangled : info.dli_sname);
+		free(demangled);
+		return true;
+	}
+	// not exported, module + offset is the best we can do without debug info
+	if (!info.dli_fname) return false;
+	char offset[32];
+	toCString((u64)((uintptr)instruction - (uintptr)info.dli_fbase), Span(offset));
+	copyString(out, info.dli_fname);
+	catString(out, "+");
+	catString(out, offset);
+	return true;
 }
 
 
 void StackTree::printCallstack(StackNode* node)
 {
+	while (node)
+	{
+		char fn_name[256];
+		int line;
+		if (getFunction(node, Span(fn_name), Ref(line))) {
+			debugOutput("\t");
+			debugOutput(fn_name);
+			debugOutput("\n");
+		}
+		else {
+			debugOutput("\tN/A\n");
+		}
+		node = node->m_parent;
+	}
 }
 
 
 StackNode* StackTree::insertChildren(StackNode* root_node, void** instruction, void** stack)
 {
-	return nullptr;
+	StackNode* node = root_node;
+	while (instruction >= stack)
+	{
+		StackNode* new_node = new StackNode;
+		node->m_first_child = new_node;
+		new_node->m_parent = node;
+		new_node->m_instruction = *instruction;
+		node = new_node;
+		--instruction;
+	}
+	return node;
 }
 
 
 StackNode* StackTree::record()
 {
-	return nullptr;
+	static const int frames_to_capture = 256;
+	void* stack_mem[frames_to_capture];
+	const int captured_frames_count = backtrace(stack_mem, frames_to_capture);
+	// skip this function and the allocator calling it
+	if (captured_frames_count <= 2) return nullptr;
+	void** stack = stack_mem + 2;
+
+	void** ptr = stack_mem + captured_frames_count - 1;
+	if (!m_root) {
+		m_root = new StackNode;
+		m_root->m_instruction = *ptr;
+		m_root->m_parent = nullptr;
+		--ptr;
+		return insertChildren(m_root, ptr, stack);
+	}
+
+	StackNode* node = m_root;
+	while (ptr >= stack)
+	{
+		while (node->m_instruction != *ptr && node->m_next)
+		{
+			node = node->m_next;
+		}
+		if (node->m_instruction != *ptr)
+		{
+			node->m_next = new StackNode;
+			node->m_next->m_parent = node->m_parent;
+			node->m_next->m_instruction = *ptr;
+			--ptr;
+			return insertChildren(node->m_next, ptr, stack);
+		}
+
+		if (node->m_first_child)
+		{
+			--ptr;
+			node = node->m_first_child;
+		}
+		else if (ptr != stack)
+		{
+			--ptr;
+			return insertChildren(node, ptr, stack);
+		}
+		else
+		{
+			return node;
+		}
+	}
+
+	return node;
 }
 
 
@@ -277,10 +388,10 @@ void* Allocator::allocate_aligned(size_t size, size_t align)
 		m_root = info;
 
 		m_total_size += size;
+		info->stack_leaf = m_stack_tree.record();
 	} // because of the MutexGuard
 
 	info->align = u16(align);
-	info->stack_leaf = m_stack_tree.record();
 	info->size = size;
 	if (m_is_fill_enabled)
 	{
@@ -382,10 +493,10 @@ void* Allocator::allocate(size_t size)
 		m_root = info;
 
 		m_total_size += size;
+		info->stack_leaf = m_stack_tree.record();
 	} // because of the MutexGuard
 
 	void* user_ptr = getUserFromSystem(system_ptr, 0);
-	info->stack_leaf = m_stack_tree.record();
 	info->size = size;
 	info->align = 0;
 	if (m_is_fill_enabled)
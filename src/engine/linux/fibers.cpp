@@ -1,9 +1,105 @@
 #include "engine/fibers.h"
 #include "engine/lumix.h"
 #include "engine/profiler.h"
-#include <ucontext.h>
-#include <stdlib.h>
-#include <string.h>
+#include "engine/sync.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+// swapcontext does a sigprocmask syscall on each switch, so we switch stacks ourselves
+// and save only callee-saved registers
+extern "C" void lumix_fiber_switch(void** from_sp, void* to_sp);
+extern "C" void lumix_fiber_start();
+
+#if defined(__x86_64__)
+	asm(R"(
+		.text
+		.globl lumix_fiber_switch
+		.type lumix_fiber_switch, @function
+		.align 16
+	lumix_fiber_switch:
+		pushq %rbp
+		pushq %rbx
+		pushq %r12
+		pushq %r13
+		pushq %r14
+		pushq %r15
+		subq $8, %rsp
+		stmxcsr (%rsp)
+		fnstcw 4(%rsp)
+		movq %rsp, (%rdi)
+		movq %rsi, %rsp
+		ldmxcsr (%rsp)
+		fldcw 4(%rsp)
+		addq $8, %rsp
+		popq %r15
+		popq %r14
+		popq %r13
+		popq %r12
+		popq %rbx
+		popq %rbp
+		ret
+		.size lumix_fiber_switch, .-lumix_fiber_switch
+
+		.globl lumix_fiber_start
+		.type lumix_fiber_start, @function
+		.align 16
+	lumix_fiber_start:
+		movq %r12, %rdi
+		callq *%r13
+		ud2
+		.size lumix_fiber_start, .-lumix_fiber_start
+	)");
+#elif defined(__aarch64__)
+	asm(R"(
+		.text
+		.globl lumix_fiber_switch
+		.type lumix_fiber_switch, %function
+		.align 4
+	lumix_fiber_switch:
+		sub sp, sp, #176
+		stp x19, x20, [sp, #0]
+		stp x21, x22, [sp, #16]
+		stp x23, x24, [sp, #32]
+		stp x25, x26, [sp, #48]
+		stp x27, x28, [sp, #64]
+		stp x29, x30, [sp, #80]
+		stp d8, d9, [sp, #96]
+		stp d10, d11, [sp, #112]
+		stp d12, d13, [sp, #128]
+		stp d14, d15, [sp, #144]
+		mrs x2, fpcr
+		str x2, [sp, #160]
+		mov x2, sp
+		str x2, [x0]
+		mov sp, x1
+		ldp x19, x20, [sp, #0]
+		ldp x21, x22, [sp, #16]
+		ldp x23, x24, [sp, #32]
+		ldp x25, x26, [sp, #48]
+		ldp x27, x28, [sp, #64]
+		ldp x29, x30, [sp, #80]
+		ldp d8, d9, [sp, #96]
+		ldp d10, d11, [sp, #112]
+		ldp d12, d13, [sp, #128]
+		ldp d14, d15, [sp, #144]
+		ldr x2, [sp, #160]
+		msr fpcr, x2
+		add sp, sp, #176
+		ret
+		.size lumix_fiber_switch, .-lumix_fiber_switch
+
+		.globl lumix_fiber_start
+		.type lumix_fiber_start, %function
+		.align 4
+	lumix_fiber_start:
+		mov x0, x19
+		blr x20
+		brk #0
+		.size lumix_fiber_start, .-lumix_fiber_start
+	)");
+#else
+	#error "Fibers are not implemented for this architecture"
+#endif
 
 namespace Lumix
 {
@@ -13,51 +109,112 @@ namespace Fiber
 {
 
 
-thread_local Handle g_finisher;
+// stacks are never unmapped, freed stacks are reused by the next create with the same size
+struct FreeStack {
+	FreeStack* next;
+	u32 size;
+};
+
+static Mutex g_stack_pool_mutex;
+static FreeStack* g_stack_pool = nullptr;
+
+
+static u32 getPageSize() {
+	static const u32 page_size = (u32)sysconf(_SC_PAGESIZE);
+	return page_size;
+}
+
+
+static u8* allocStack(u32 size) {
+	{
+		MutexGuard lock(g_stack_pool_mutex);
+		FreeStack** iter = &g_stack_pool;
+		while (*iter) {
+			FreeStack* free_stack = *iter;
+			if (free_stack->size == size) {
+				*iter = free_stack->next;
+				return (u8*)free_stack - getPageSize();
+			}
+			iter = &free_stack->next;
+		}
+	}
+
+	const u32 page_size = getPageSize();
+	void* mem = mmap(nullptr, size + page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+	if (mem == MAP_FAILED) return nullptr;
+	// guard page, stack grows down so overflow hits it instead of other memory
+	mprotect(mem, page_size, PROT_NONE);
+	return (u8*)mem;
+}
 
 
 void initThread(FiberProc proc, Handle* out)
 {
-	*out = create(64*1024, proc, nullptr);
-	getcontext(&g_finisher);
-	out->uc_link = &g_finisher;
-	switchTo(&g_finisher, *out);
+	// thread's own stack is used by the primary fiber, switchTo fills in `out`
+	*out = INVALID_FIBER;
+	proc(nullptr);
 }
 
 
 Handle create(int stack_size, FiberProc proc, void* parameter)
 {
-	ucontext_t fib;
-	getcontext(&fib);
-    fib.uc_stack.ss_sp = (::malloc)(stack_size);
-    fib.uc_stack.ss_size = stack_size;
-    fib.uc_link = 0;
-    makecontext(&fib, (void(*)())proc, 1, parameter); 
-	return fib;
+	const u32 page_size = getPageSize();
+	const u32 size = (u32(stack_size) + page_size - 1) & ~(page_size - 1);
+	Handle fiber = INVALID_FIBER;
+	fiber.stack = allocStack(size);
+	if (!fiber.stack) return INVALID_FIBER;
+	fiber.stack_size = size;
+
+	// initial frame, popped by lumix_fiber_switch, which then returns to lumix_fiber_start
+	u64* top = (u64*)(fiber.stack + page_size + size);
+	#if defined(__x86_64__)
+		top -= 2; // 16B aligned after `ret`, null return address for debuggers
+		top[0] = top[1] = 0;
+		top -= 8;
+		top[0] = 0x1F80 | (u64(0x037F) << 32); // default mxcsr and x87 control word
+		top[1] = 0; // r15
+		top[2] = 0; // r14
+		top[3] = (u64)proc; // r13
+		top[4] = (u64)parameter; // r12
+		top[5] = 0; // rbx
+		top[6] = 0; // rbp
+		top[7] = (u64)&lumix_fiber_start;
+	#else
+		top -= 22;
+		for (u32 i = 0; i < 22; ++i) top[i] = 0;
+		top[0] = (u64)parameter; // x19
+		top[1] = (u64)proc; // x20
+		top[11] = (u64)&lumix_fiber_start; // x30
+	#endif
+	fiber.sp = top;
+	return fiber;
 }
 
+
 bool isValid(Handle handle)
 {
-	return handle.uc_stack.ss_sp != nullptr;
+	return handle.sp != nullptr;
 }
 
+
 void destroy(Handle fiber)
 {
-	ASSERT(false);
+	ASSERT(fiber.stack);
+	FreeStack* free_stack = (FreeStack*)(fiber.stack + getPageSize());
+	free_stack->size = fiber.stack_size;
+	MutexGuard lock(g_stack_pool_mutex);
+	free_stack->next = g_stack_pool;
+	g_stack_pool = free_stack;
 }
 
 
 void switchTo(Handle* prev, Handle fiber)
 {
 	profiler::beforeFiberSwitch();
-	swapcontext(prev, &fiber); 
-}
-
-
-void* getParameter()
-{
-	ASSERT(false);
-	return nullptr;
+	// thread's own stack for the primary fiber, guard page is not part of the stack
+	if (fiber.stack) profiler::setFiberStack(fiber.stack + getPageSize(), fiber.stack + getPageSize() + fiber.stack_size);
+	else profiler::setFiberStack(nullptr, nullptr);
+	lumix_fiber_switch(&prev->sp, fiber.sp);
 }
 
 
@@ -78,7 +78,8 @@ void init() {
 
 	XInitThreads();
 	G.display = XOpenDisplay(nullptr);
-	G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
+	// no X server, e.g. headless CI, windows can not be created but the rest works
+	if (G.display) G.im = XOpenIM(G.display, nullptr, nullptr, nullptr);
 
 	struct {
 		KeySym x11;
@@ -264,6 +265,7 @@ void init() {
 		s_keycode_names[(u8)m.lumix] = m.name;
 	}
 
+	if (!G.display) return;
     G.net_wm_state_atom = XInternAtom(G.display, "_NET_WM_STATE", False);
     G.net_wm_state_maximized_horz_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_HORZ", False);
     G.net_wm_state_maximized_vert_atom = XInternAtom(G.display, "_NET_WM_STATE_MAXIMIZED_VERT", False);
@@ -442,7 +444,7 @@ bool getEvent(Ref<Event> e) {
 	}
 
 	next:
-	if (XPending(G.display) <= 0) return false;
+	if (!G.display || XPending(G.display) <= 0) return false;
 	XEvent xevent;
 	XNextEvent(G.display, &xevent);
 	
@@ -865,17 +867,27 @@ u32 getMemPageSize() {
 }
 
 void* memReserve(size_t size) {
-	void* mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-	ASSERT(mem);
-	return mem;
+	void* mem = mmap(nullptr, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	ASSERT(mem != MAP_FAILED);
+	return mem == MAP_FAILED ? nullptr : mem;
 }
 
 void memCommit(void* ptr, size_t size) {
-	// noop on linux
+	const int res = mprotect(ptr, size, PROT_READ | PROT_WRITE);
+	ASSERT(res == 0);
 }
 
-void memRelease(void* ptr) {
-	free(ptr);
+void memDecommit(void* ptr, size_t size) {
+	madvise(ptr, size, MADV_DONTNEED);
+	mprotect(ptr, size, PROT_NONE);
+}
+
+void memAdviseHugePages(void* ptr, size_t size) {
+	madvise(ptr, size, MADV_HUGEPAGE);
+}
+
+void memRelease(void* ptr, size_t size) {
+	munmap(ptr, size);
 }
 
 struct FileIterator {};
@@ -1167,7 +1179,8 @@ u64 Timer::getFrequency()
 u64 Timer::getRawTimestamp()
 {
 	timespec tick;
-	clock_gettime(CLOCK_REALTIME, &tick);
+	// monotonic, so it does not jump when system time changes, and perf_event_open can use the same clock
+	clock_gettime(CLOCK_MONOTONIC, &tick);
 	return u64(tick.tv_sec) * 1000000000 + u64(tick.tv_nsec);
 }
 
@@ -165,7 +165,12 @@ LUMIX_ENGINE_API ThreadID getCurrentThreadID();
 
 LUMIX_ENGINE_API void* memReserve(size_t size);
 LUMIX_ENGINE_API void memCommit(void* ptr, size_t size);
-LUMIX_ENGINE_API void memRelease(void* ptr);
+// physical memory is returned to OS, address range stays reserved
+LUMIX_ENGINE_API void memDecommit(void* ptr, size_t size);
+// hint that committed range should be backed by huge pages, noop where not supported
+LUMIX_ENGINE_API void memAdviseHugePages(void* ptr, size_t size);
+// size must be the same as in memReserve
+LUMIX_ENGINE_API void memRelease(void* ptr, size_t size);
 LUMIX_ENGINE_API u32 getMemPageSize();
 
 LUMIX_ENGINE_API FileIterator* createFileIterator(const char* path, IAllocator& allocator);
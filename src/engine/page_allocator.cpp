@@ -1,6 +1,7 @@
 #include "engine/allocator.h"
 #include "engine/crt.h"
 #include "engine/atomic.h"
+#include "engine/log.h"
 #include "engine/page_allocator.h"
 #include "engine/os.h"
 
@@ -9,57 +10,250 @@ namespace Lumix
 {
 
 
+// pages moved between thread cache and the shared free list at once
+static constexpr u32 PAGE_CACHE_BATCH = 16;
+static constexpr u32 PAGE_CACHES_PER_THREAD = 2;
+
+
+struct PageCache {
+	static PageCache* get(PageAllocator* allocator);
+	// returns cached pages to the allocator and frees the slot
+	void flush();
+
+	PageAllocator* allocator = nullptr;
+	u32 count = 0;
+	void* pages[PAGE_CACHE_BATCH * 2];
+};
+
+
+// flushes caches of a thread when it exits, so short-lived threads do not leak cached pages
+// registered only when the thread starts using a cache, so allocate/deallocate do not pay for thread_local destructor
+struct PageCacheFlusher {
+	~PageCacheFlusher();
+	void registerThread();
+
+	PageCache* caches = nullptr;
+	PageCacheFlusher* next = nullptr;
+	PageCacheFlusher* prev = nullptr;
+};
+
+
+static thread_local PageCache g_page_caches[PAGE_CACHES_PER_THREAD];
+static thread_local PageCacheFlusher g_page_cache_flusher;
+// guards the list of flushers and flushing caches, which can happen from other threads
+static Mutex g_page_cache_mutex;
+static PageCacheFlusher* g_page_cache_flushers = nullptr;
+
+
+void PageCache::flush() {
+	if (count > 0) allocator->freeLocked(pages, count);
+	count = 0;
+	allocator = nullptr;
+}
+
+
+void PageCacheFlusher::registerThread() {
+	if (caches) return;
+	caches = g_page_caches;
+	MutexGuard lock(g_page_cache_mutex);
+	next = g_page_cache_flushers;
+	if (next) next->prev = this;
+	g_page_cache_flushers = this;
+}
+
+
+PageCacheFlusher::~PageCacheFlusher() {
+	if (!caches) return;
+	MutexGuard lock(g_page_cache_mutex);
+	// allocator destroyed before this thread exited already flushed its slot
+	for (u32 i = 0; i < PAGE_CACHES_PER_THREAD; ++i) {
+		if (caches[i].allocator) caches[i].flush();
+	}
+	if (prev) prev->next = next;
+	else g_page_cache_flushers = next;
+	if (next) next->prev = prev;
+}
+
+
+PageCache* PageCache::get(PageAllocator* allocator) {
+	for (PageCache& cache : g_page_caches) {
+		if (cache.allocator == allocator) return &cache;
+	}
+	for (PageCache& cache : g_page_caches) {
+		if (!cache.allocator) {
+			g_page_cache_flusher.registerThread();
+			cache.allocator = allocator;
+			return &cache;
+		}
+	}
+	// more allocators than slots, use the shared list directly
+	return nullptr;
+}
+
+
+PageAllocator::PageAllocator()
+{
+	// one extra chunk so the region can be aligned to chunk size, which huge pages need
+	reserved_mem = (u8*)os::memReserve(size_t(CHUNK_SIZE) * (MAX_CHUNKS + 1));
+	chunks_mem = (u8*)(((uintptr)reserved_mem + CHUNK_SIZE - 1) & ~(uintptr)(CHUNK_SIZE - 1));
+	memset(chunk_free_counts, 0, sizeof(chunk_free_counts));
+}
+
+
 PageAllocator::~PageAllocator()
 {
-	ASSERT(allocated_count == 0);
-	void* p = free_pages;
-	while (p) {
-		void* tmp = p;
-		memcpy(&p, p, sizeof(p)); //-V579
-		os::memRelease(tmp);
+	{
+		// pages cached by threads which are still running are not leaked
+		MutexGuard lock(g_page_cache_mutex);
+		for (PageCacheFlusher* flusher = g_page_cache_flushers; flusher; flusher = flusher->next) {
+			for (u32 i = 0; i < PAGE_CACHES_PER_THREAD; ++i) {
+				if (flusher->caches[i].allocator == this) flusher->caches[i].flush();
+			}
+		}
 	}
+	ASSERT(getAllocatedCount() == 0);
+	os::memRelease(reserved_mem, size_t(CHUNK_SIZE) * (MAX_CHUNKS + 1));
 }
 
 
-void PageAllocator::lock()
+u32 PageAllocator::getChunk(const void* page) const
 {
-	mutex.enter();
+	return u32(((const u8*)page - chunks_mem) / CHUNK_SIZE);
 }
 
 
-void PageAllocator::unlock()
+void PageAllocator::allocLocked(void** pages, u32 count)
 {
-	mutex.exit();
+	MutexGuard lock(mutex);
+	for (u32 i = 0; i < count; ++i) {
+		void* page;
+		if (free_pages) {
+			page = free_pages;
+			memcpy(&free_pages, free_pages, sizeof(free_pages)); //-V579
+		}
+		else {
+			if (fresh_begin == fresh_end) {
+				u32 chunk;
+				if (decommitted_chunks_count > 0) {
+					--decommitted_chunks_count;
+					chunk = decommitted_chunks[decommitted_chunks_count];
+				}
+				else {
+					LUMIX_FATAL(chunks_count < MAX_CHUNKS);
+					chunk = chunks_count;
+					++chunks_count;
+				}
+				fresh_begin = chunks_mem + size_t(chunk) * CHUNK_SIZE;
+				fresh_end = fresh_begin + CHUNK_SIZE;
+				os::memCommit(fresh_begin, CHUNK_SIZE);
+				if (huge_pages) os::memAdviseHugePages(fresh_begin, CHUNK_SIZE);
+				chunk_free_counts[chunk] = PAGES_PER_CHUNK;
+				reserved_count += PAGES_PER_CHUNK;
+				free_count += PAGES_PER_CHUNK;
+			}
+			page = fresh_begin;
+			fresh_begin += PAGE_SIZE;
+		}
+		--chunk_free_counts[getChunk(page)];
+		--free_count;
+		pages[i] = page;
+	}
 }
 
 
-void* PageAllocator::allocate(bool lock)
+void PageAllocator::freeLocked(void* const* pages, u32 count)
 {
-	if (lock) mutex.enter();
-	++allocated_count;
-	if (free_pages) {
-		void* tmp = free_pages;
-		memcpy(&free_pages, free_pages, sizeof(free_pages)); //-V579
-		if (lock) mutex.exit();
-		return tmp;
+	MutexGuard lock(mutex);
+	for (u32 i = 0; i < count; ++i) {
+		void* page = pages[i];
+		memcpy(page, &free_pages, sizeof(free_pages));
+		free_pages = page;
+		++chunk_free_counts[getChunk(page)];
+		++free_count;
 	}
-	++reserved_count;
-	if (lock) mutex.exit();
-	void* mem = os::memReserve(PAGE_SIZE);
-	ASSERT(uintptr(mem) % PAGE_SIZE == 0);
-	os::memCommit(mem, PAGE_SIZE);
-	return mem;
 }
 
 
-void PageAllocator::deallocate(void* mem, bool lock)
+void* PageAllocator::allocate()
 {
-	if (lock) mutex.enter();
-	--allocated_count;
-	memcpy(mem, &free_pages, sizeof(free_pages));
-	free_pages = mem;
-	if (lock) mutex.exit();
+	PageCache* cache = PageCache::get(this);
+	if (!cache) {
+		void* page;
+		allocLocked(&page, 1);
+		return page;
+	}
+
+	if (cache->count == 0) {
+		allocLocked(cache->pages, PAGE_CACHE_BATCH);
+		cache->count = PAGE_CACHE_BATCH;
+	}
+	--cache->count;
+	return cache->pages[cache->count];
+}
+
+
+void PageAllocator::deallocate(void* mem)
+{
+	PageCache* cache = PageCache::get(this);
+	if (!cache) {
+		freeLocked(&mem, 1);
+		return;
+	}
+
+	if (cache->count == lengthOf(cache->pages)) {
+		freeLocked(cache->pages + PAGE_CACHE_BATCH, PAGE_CACHE_BATCH);
+		cache->count = PAGE_CACHE_BATCH;
+	}
+	cache->pages[cache->count] = mem;
+	++cache->count;
+}
+
+
+u32 PageAllocator::trim()
+{
+	// pages cached by other threads are not touched, so chunks containing them stay committed
+	PageCache* cache = PageCache::get(this);
+	if (cache && cache->count > 0) {
+		freeLocked(cache->pages, cache->count);
+		cache->count = 0;
+	}
+
+	MutexGuard lock(mutex);
+	const u32 fresh_chunk = fresh_begin != fresh_end ? getChunk(fresh_begin) : 0xffFFffFF;
+	auto isIdle = [&](u32 chunk){
+		return chunk != fresh_chunk && chunk_free_counts[chunk] == PAGES_PER_CHUNK;
+	};
+
+	// unlink pages of idle chunks from the free list
+	void* prev = nullptr;
+	void* page = free_pages;
+	while (page) {
+		void* next;
+		memcpy(&next, page, sizeof(next)); //-V579
+		if (isIdle(getChunk(page))) {
+			if (prev) memcpy(prev, &next, sizeof(next));
+			else free_pages = next;
+		}
+		else {
+			prev = page;
+		}
+		page = next;
+	}
+
+	u32 trimmed = 0;
+	for (u32 chunk = 0; chunk < chunks_count; ++chunk) {
+		if (!isIdle(chunk)) continue;
+		os::memDecommit(chunks_mem + size_t(chunk) * CHUNK_SIZE, CHUNK_SIZE);
+		// decommitted chunks are not in any list, so 0 keeps them from being idle again
+		chunk_free_counts[chunk] = 0;
+		decommitted_chunks[decommitted_chunks_count] = chunk;
+		++decommitted_chunks_count;
+		reserved_count -= PAGES_PER_CHUNK;
+		free_count -= PAGES_PER_CHUNK;
+		trimmed += PAGES_PER_CHUNK;
+	}
+	return trimmed;
 }
 
 
-} // namespace Lumix
\ No newline at end of file
+} // namespace Lumix
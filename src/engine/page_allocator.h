@@ -9,6 +9,8 @@ namespace Lumix
 {
 
 
+// pages are carved from 2MB chunks of one reserved region
+// each thread keeps a small cache of free pages, so the mutex is taken only once per batch
 struct LUMIX_ENGINE_API PageAllocator final
 {
 public:
@@ -17,21 +19,48 @@ public:
 	#else
 		enum { PAGE_SIZE = 16384 };
 	#endif
+	enum { 
+		CHUNK_SIZE = 2 * 1024 * 1024,
+		PAGES_PER_CHUNK = CHUNK_SIZE / PAGE_SIZE,
+		MAX_CHUNKS = 2048
+	};
 
+	PageAllocator();
 	~PageAllocator();
 		
-	void* allocate(bool lock);
-	void deallocate(void* mem, bool lock);
-	u32 getAllocatedCount() const { return allocated_count; }
+	void* allocate();
+	void deallocate(void* mem);
+	// only affects chunks committed later, noop where huge pages are not supported
+	void enableHugePages(bool enable) { huge_pages = enable; }
+	// decommits chunks which have no allocated pages, e.g. after a load spike, returns number of decommitted pages
+	u32 trim();
+	// includes pages cached by threads
+	u32 getAllocatedCount() const { return reserved_count - free_count; }
+	// committed pages
 	u32 getReservedCount() const { return reserved_count; }
-
-	void lock();
-	void unlock();
 		
 private:
-	u32 allocated_count = 0;
+	friend struct PageCache;
+
+	void allocLocked(void** pages, u32 count);
+	void freeLocked(void* const* pages, u32 count);
+	u32 getChunk(const void* page) const;
+
+	u8* reserved_mem;
+	// reserved_mem aligned to CHUNK_SIZE
+	u8* chunks_mem;
 	u32 reserved_count = 0;
+	u32 free_count = 0;
 	void* free_pages = nullptr;
+	// chunk which is being carved, pages after fresh_begin were never used
+	u8* fresh_begin = nullptr;
+	u8* fresh_end = nullptr;
+	u32 chunks_count = 0;
+	// free pages in each chunk, including never used ones
+	u16 chunk_free_counts[MAX_CHUNKS];
+	u16 decommitted_chunks[MAX_CHUNKS];
+	u32 decommitted_chunks_count = 0;
+	bool huge_pages = false;
 	Mutex mutex;
 };
 
@@ -70,7 +99,7 @@ struct PagedList
 		while(i) {
 			T* tmp = i;
 			i = i->header.next;
-			allocator.deallocate(tmp, true);
+			allocator.deallocate(tmp);
 		}
 	}
 
@@ -82,31 +111,25 @@ struct PagedList
 	T* detach()
 	{
 		T* tmp = begin;
-		begin = end = nullptr;
+		begin = nullptr;
 		return tmp;
 	}
 
 
+	// lock-free, pages are prepended, so they are in reverse order of push
 	T* push()
 	{
-		allocator.lock();
-		void* mem = allocator.allocate(false);
+		void* mem = allocator.allocate();
 		T* page = new (NewPlaceholder(), mem) T;
-		if(!begin) {
-			begin = end = page;
-		}
-		else {
-			end->header.next = page;
-			page->header.next = nullptr;
-			end = page;
+		for (;;) {
+			T* tmp = begin;
+			page->header.next = tmp;
+			if (compareAndExchange64((volatile i64*)&begin, (i64)page, (i64)tmp)) return page;
 		}
-		allocator.unlock();
-		return page;
 	}
 
 
-	T* begin = nullptr;
-	T* end = nullptr;
+	T* volatile begin = nullptr;
 	PageAllocator& allocator;
 };
 
@@ -1,11 +1,12 @@
 #include "engine/lumix.h"
 #include "engine/path.h"
 
+#include "engine/atomic.h"
 #include "engine/crc32.h"
-#include "engine/hash_map.h"
+#include "engine/crt.h"
+#include "engine/log.h"
+#include "engine/os.h"
 #include "engine/sync.h"
-#include "engine/path.h"
-#include "engine/stream.h"
 #include "engine/string.h"
 
 
@@ -13,37 +14,165 @@ namespace Lumix
 {
 
 
-Path::Path()
-	: m_hash(0)
-	, m_path{}
-{}
+namespace {
+
+struct PathEntry {
+	const char* str;
+	u32 hash;
+	u32 length;
+};
+
+// handles are only created by PathTable, which sets this, so entries can be read without locking
+static PathEntry* g_path_entries = nullptr;
+
+// interned strings, handle is index to `entries`, handle 0 is empty path
+struct PathTable {
+	struct Buckets {
+		u32 mask;
+		u32 handles[1];
+	};
+
+	static constexpr u32 MAX_PATHS = 1 << 22;
+	static constexpr size_t STRINGS_RESERVE = 512 * 1024 * 1024;
+	static constexpr size_t COMMIT_STEP = 64 * 1024;
+
+	PathTable() {
+		entries = (PathEntry*)os::memReserve(sizeof(PathEntry) * MAX_PATHS);
+		strings = (char*)os::memReserve(STRINGS_RESERVE);
+		os::memCommit(entries, COMMIT_STEP);
+		os::memCommit(strings, COMMIT_STEP);
+		entries_committed = COMMIT_STEP;
+		strings_committed = COMMIT_STEP;
+		strings[0] = '\0';
+		strings_size = 1;
+		entries[0] = { strings, 0, 0 };
+		count = 1;
+		growBuckets(1024);
+		g_path_entries = entries;
+	}
+
+	// old bucket arrays are never freed, so lookups can run without locking while the table grows
+	void growBuckets(u32 new_capacity) {
+		Buckets* new_buckets = (Buckets*)os::memReserve(sizeof(Buckets) + sizeof(u32) * new_capacity);
+		os::memCommit(new_buckets, sizeof(Buckets) + sizeof(u32) * new_capacity);
+		memset(new_buckets, 0, sizeof(Buckets) + sizeof(u32) * new_capacity);
+		new_buckets->mask = new_capacity - 1;
+		if (buckets) {
+			for (u32 i = 0; i <= buckets->mask; ++i) {
+				const u32 handle = buckets->handles[i];
+				if (handle == 0) continue;
+				u32 pos = entries[handle].hash & new_buckets->mask;
+				while (new_buckets->handles[pos]) pos = (pos + 1) & new_buckets->mask;
+				new_buckets->handles[pos] = handle;
+			}
+		}
+		writeBarrier();
+		buckets = new_buckets;
+	}
+
+	// returns 0 if path is not in the table, pos is set to the empty bucket where probing stopped
+	u32 find(const Buckets& b, const char* path, u32 length, u32 hash, u32& pos) const {
+		pos = hash & b.mask;
+		for (;;) {
+			const u32 handle = b.handles[pos];
+			if (handle == 0) return 0;
+			readBarrier();
+			// different paths can have the same hash, so strings are compared too
+			const PathEntry& e = entries[handle];
+			if (e.hash == hash && e.length == length && memcmp(e.str, path, length) == 0) return handle;
+			pos = (pos + 1) & b.mask;
+		}
+	}
+
+	char* allocString(u32 size) {
+		LUMIX_FATAL(strings_size + size <= STRINGS_RESERVE);
+		while (strings_size + size > strings_committed) {
+			os::memCommit(strings + strings_committed, COMMIT_STEP);
+			strings_committed += COMMIT_STEP;
+		}
+		char* res = strings + strings_size;
+		strings_size += size;
+		return res;
+	}
 
-//Path::Path(const Path& rhs)
-//	: m_hash(rhs.m_hash)
-//{
-//	copyString(m_path, rhs.m_path);
-//}
+	// path must be normalized
+	u32 intern(const char* path, u32 length, u32 hash) {
+		if (length == 0) return 0;
+
+		u32 pos;
+		const Buckets* b = buckets;
+		readBarrier();
+		u32 handle = find(*b, path, length, hash, pos);
+		if (handle) return handle;
+
+		MutexGuard lock(mutex);
+		// somebody could have added it before we locked
+		handle = find(*buckets, path, length, hash, pos);
+		if (handle) return handle;
+
+		LUMIX_FATAL(count < MAX_PATHS);
+		if ((count + 1) * sizeof(PathEntry) > entries_committed) {
+			os::memCommit((u8*)entries + entries_committed, COMMIT_STEP);
+			entries_committed += COMMIT_STEP;
+		}
+		char* str = allocString(length + 1);
+		memcpy(str, path, length + 1);
+		handle = count;
+		entries[handle] = { str, hash, length };
+		++count;
+		// entry must be complete before lock-free readers can see the handle
+		writeBarrier();
+		buckets->handles[pos] = handle;
+		if (count * 2 > buckets->mask + 1) growBuckets((buckets->mask + 1) * 2);
+		return handle;
+	}
+
+	Mutex mutex;
+	PathEntry* entries = nullptr;
+	u32 count = 0;
+	size_t entries_committed = 0;
+	char* strings = nullptr;
+	size_t strings_size = 0;
+	size_t strings_committed = 0;
+	Buckets* volatile buckets = nullptr;
+};
+
+PathTable& getPathTable() {
+	static PathTable table;
+	return table;
+}
 
-Path::Path(const char* path) {
-	normalize(path, Span(m_path));
-	m_hash = crc32(m_path);
+u32 internPath(const char* path) {
+	char tmp[LUMIX_MAX_PATH];
+	Path::normalize(path, Span(tmp));
+	const u32 hash = crc32(tmp);
+	return getPathTable().intern(tmp, stringLength(tmp), hash);
 }
 
+} // anonymous namespace
+
+
+Path::Path(const char* path)
+	: m_handle(internPath(path))
+{}
+
 i32 Path::length() const {
-	return stringLength(m_path);
+	if (m_handle == 0) return 0;
+	return g_path_entries[m_handle].length;
 }
 
-void Path::operator =(const char* rhs) {
-	normalize(rhs, Span(m_path));
-	m_hash = crc32(m_path);
+u32 Path::getHash() const {
+	if (m_handle == 0) return 0;
+	return g_path_entries[m_handle].hash;
 }
 
-bool Path::operator==(const Path& rhs) const {
-	return m_hash == rhs.m_hash;
+const char* Path::c_str() const {
+	if (m_handle == 0) return "";
+	return g_path_entries[m_handle].str;
 }
 
-bool Path::operator!=(const Path& rhs) const {
-	return m_hash != rhs.m_hash;
+void Path::operator =(const char* rhs) {
+	m_handle = internPath(rhs);
 }
 
 void Path::normalize(const char* path, Span<char> output)
@@ -15,6 +15,8 @@ struct LUMIX_ENGINE_API PathInfo
 	char m_dir[LUMIX_MAX_PATH];
 };
 
+// handle to a string in global interned path table, copies and comparisons are just integer operations
+// strings in the table are never freed, so c_str() is valid forever
 struct LUMIX_ENGINE_API Path {
 	static void normalize(const char* path, Span<char> out);
 	static Span<const char> getDir(const char* src);
@@ -23,21 +25,21 @@ struct LUMIX_ENGINE_API Path {
 	static bool hasExtension(const char* filename, const char* ext);
 	static bool replaceExtension(char* path, const char* ext);
 
-	Path();
+	Path() : m_handle(0) {}
 	explicit Path(const char* path);
 
 	void operator=(const char* rhs);
-	bool operator==(const Path& rhs) const;
-	bool operator!=(const Path& rhs) const;
+	bool operator==(const Path& rhs) const { return m_handle == rhs.m_handle; }
+	bool operator!=(const Path& rhs) const { return m_handle != rhs.m_handle; }
 
 	i32 length() const;
-	u32 getHash() const { return m_hash; }
-	const char* c_str() const { return m_path; }
-	bool isValid() const { return m_path[0] != '\0'; }
+	// crc32 of the normalized path
+	u32 getHash() const;
+	const char* c_str() const;
+	bool isValid() const { return m_handle != 0; }
 
 private:
-	char m_path[LUMIX_MAX_PATH];
-	u32 m_hash;
+	u32 m_handle;
 };
 
 
@@ -3,15 +3,29 @@
 	#define NOGDI 
 	#include <Windows.h>
 	#include <evntcons.h>
+#else
+	#include <errno.h>
+	#include <fcntl.h>
+	#include <linux/perf_event.h>
+	#include <poll.h>
+	#include <pthread.h>
+	#include <signal.h>
+	#include <sys/mman.h>
+	#include <sys/syscall.h>
+	#include <time.h>
+	#include <unistd.h>
 #endif
 
 #include "engine/array.h"
 #include "engine/crt.h"
+#include "engine/hash.h"
 #include "engine/hash_map.h"
 #include "engine/allocators.h"
 #include "engine/atomic.h"
 #include "engine/math.h"
+#include "engine/queue.h"
 #include "engine/string.h"
+#include "engine/stream.h"
 #include "engine/sync.h"
 #include "engine/thread.h"
 #include "engine/os.h"
@@ -25,26 +39,60 @@ namespace profiler
 {
 
 
+#ifndef _WIN32
+	static constexpr u32 MAX_SAMPLE_FRAMES = 32;
+
+	struct Sample {
+		u32 frames_count;
+		void* frames[MAX_SAMPLE_FRAMES];
+	};
+
+	// pushed from signal handler, popped in frame()
+	using SampleQueue = SPSCQueue<Sample, 64>;
+#endif
+
+
 struct ThreadContext
 {
 	ThreadContext(IAllocator& allocator) 
 		: buffer(allocator)
 		, open_blocks(allocator)
 	{
-		buffer.resize(1024 * 512);
+		buffer.resize(BUFFER_SIZE);
 		open_blocks.reserve(64);
 	}
 
+	// power of two, so positions in buffer are cheap to compute
+	static constexpr u32 BUFFER_SIZE = 512 * 1024;
+
 	Array<const char*> open_blocks;
+	// ring buffer written only by the owning thread, without locks
+	// begin and end are sequence counters, readers use them to find events which were not overwritten during a copy
 	OutputMemoryStream buffer;
-	u32 begin = 0;
-	u32 end = 0;
+	volatile u32 begin = 0;
+	volatile u32 end = 0;
+	// guards name, show_in_profiler and writes to global context, which has many writers
 	Mutex mutex;
 	StaticString<64> name;
 	bool show_in_profiler = false;
 	u32 thread_id;
+	#ifndef _WIN32
+		SampleQueue* samples = nullptr;
+		timer_t sampling_timer;
+		bool is_sampled = false;
+		// the signal handler walks frame pointers only inside the stack it was interrupted on
+		const u8* thread_stack_begin = nullptr;
+		const u8* thread_stack_end = nullptr;
+		// written by the owning thread, begin first, see setFiberStack
+		const u8* volatile fiber_stack_begin = nullptr;
+		const u8* volatile fiber_stack_end = nullptr;
+	#endif
 };
 
+
+// constant initialized, so there's no guard on every access, it's also safe to use in signal handler
+static thread_local ThreadContext* g_thread_context = nullptr;
+
 #ifdef _WIN32
 	#define SWITCH_CONTEXT_OPCODE 36
 
@@ -84,12 +132,35 @@ struct ThreadContext
 		TRACEHANDLE open_handle;
 	};
 #else
-	struct TraceTask {
-		TraceTask(IAllocator&) {}
-		void destroy() {}
-		int open_handle;
+	// sched_switch tracepoint read through perf_event_open, one ring buffer per cpu
+	// needs CAP_PERFMON (or kernel.perf_event_paranoid = -1) and tracefs
+	struct TraceTask : Thread {
+		// per cpu, must be power of two
+		static constexpr u32 BUFFER_PAGES = 64;
+
+		struct CPUBuffer {
+			int fd;
+			u8* mem;
+		};
+
+		TraceTask(IAllocator& allocator);
+
+		bool open();
+		void close();
+		int task() override;
+		void read(CPUBuffer& buffer);
+		void updateKnownThreads();
+		bool isKnownThread(u32 thread_id) const;
+
+		Array<CPUBuffer> buffers;
+		Array<ContextSwitchRecord> records;
+		Array<u32> known_threads;
+		u32 page_size = 0;
+		u32 prev_pid_offset = 0;
+		u32 prev_state_offset = 0;
+		u32 next_pid_offset = 0;
+		volatile bool finished = false;
 	};
-	void CloseTrace(int) {}
 #endif
 
 static struct Instance
@@ -105,8 +176,18 @@ static struct Instance
 
 	~Instance()
 	{
-		CloseTrace(trace_task.open_handle);
-		trace_task.destroy();
+		#ifdef _WIN32
+			CloseTrace(trace_task.open_handle);
+			trace_task.destroy();
+		#else
+			if (context_switches_enabled) {
+				trace_task.finished = true;
+				trace_task.destroy();
+			}
+			trace_task.close();
+			MutexGuard lock(mutex);
+			for (ThreadContext* ctx : contexts) stopSampling(*ctx);
+		#endif
 	}
 
 
@@ -145,24 +226,89 @@ static struct Instance
 			trace.EventRecordCallback = TraceTask::callback;
 			trace_task.open_handle = OpenTrace(&trace);
 			trace_task.create("profiler trace", true);
+		#else
+			context_switches_enabled = trace_task.open();
+			if (context_switches_enabled) trace_task.create("profiler trace", true);
 		#endif
 	}
 
 
-	ThreadContext* getThreadContext()
+	ThreadContext* createThreadContext()
 	{
-		thread_local ThreadContext* ctx = [&](){
-			ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator);
+		ThreadContext* new_ctx = LUMIX_NEW(allocator, ThreadContext)(allocator);
+		#ifdef _WIN32
 			new_ctx->thread_id = os::getCurrentThreadID();
-			MutexGuard lock(mutex);
-			contexts.push(new_ctx);
-			return new_ctx;
-		}();
+		#else
+			// kernel thread id, context switches are reported with it
+			new_ctx->thread_id = (u32)syscall(SYS_gettid);
+			pthread_attr_t attr;
+			if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+				void* stack;
+				size_t stack_size;
+				if (pthread_attr_getstack(&attr, &stack, &stack_size) == 0) {
+					new_ctx->thread_stack_begin = (const u8*)stack;
+					new_ctx->thread_stack_end = (const u8*)stack + stack_size;
+				}
+				pthread_attr_destroy(&attr);
+			}
+		#endif
+		MutexGuard lock(mutex);
+		contexts.push(new_ctx);
+		#ifndef _WIN32
+			if (sampling_interval_us != 0) startSampling(*new_ctx);
+		#endif
+		return new_ctx;
+	}
 
-		return ctx;
+
+	LUMIX_FORCE_INLINE ThreadContext* getThreadContext()
+	{
+		if (!g_thread_context) g_thread_context = createThreadContext();
+		return g_thread_context;
 	}
 
 
+	#ifndef _WIN32
+		// mutex must be locked
+		bool startSampling(ThreadContext& ctx) {
+			if (ctx.is_sampled) return true;
+			if (!ctx.samples) {
+				ctx.samples = LUMIX_NEW(allocator, SampleQueue);
+				// signal handler must see initialized queue
+				writeBarrier();
+			}
+
+			// cpu time clock of the thread, see MAKE_THREAD_CPUCLOCK in linux/posix-timers.h
+			const clockid_t clock = clockid_t((~ctx.thread_id << 3) | 6);
+			sigevent event = {};
+			event.sigev_notify = SIGEV_THREAD_ID;
+			event.sigev_signo = SIGPROF;
+			event._sigev_un._tid = ctx.thread_id;
+			// fails if the thread already exited
+			if (timer_create(clock, &event, &ctx.sampling_timer) != 0) return false;
+
+			itimerspec spec = {};
+			spec.it_interval.tv_sec = sampling_interval_us / 1'000'000;
+			spec.it_interval.tv_nsec = (sampling_interval_us % 1'000'000) * 1000;
+			spec.it_value = spec.it_interval;
+			if (timer_settime(ctx.sampling_timer, 0, &spec, nullptr) != 0) {
+				timer_delete(ctx.sampling_timer);
+				return false;
+			}
+			ctx.is_sampled = true;
+			return true;
+		}
+
+
+		// mutex must be locked
+		void stopSampling(ThreadContext& ctx) {
+			if (!ctx.is_sampled) return;
+			timer_delete(ctx.sampling_timer);
+			ctx.is_sampled = false;
+		}
+	#endif
+
+
 	DefaultAllocator allocator;
 	Array<ThreadContext*> contexts;
 	Mutex mutex;
@@ -175,85 +321,108 @@ static struct Instance
 	volatile i32 fiber_wait_id = 0;
 	TraceTask trace_task;
 	ThreadContext global_context;
+	struct Counter {
+		const char* name;
+		double min;
+		double max;
+		double sum;
+		u32 count;
+	};
+	Mutex counters_mutex;
+	// never removed, there are only a few of them so linear search is fine
+	Array<Counter> counters{allocator};
+	#ifndef _WIN32
+		u32 sampling_interval_us = 0;
+		bool sampling_handler_installed = false;
+		// used in frame() to aggregate samples
+		HashMap<u64, u32> sample_map{allocator};
+		Array<Sample> unique_samples{allocator};
+		Array<u32> sample_counts{allocator};
+	#endif
 } g_instance;
 
 
 template <typename T>
-void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
+static void read(const u8* buf, u32 buf_size, u32 p, T& value)
 {
-	if (g_instance.paused && timestamp > g_instance.paused_time) return;
+	ASSERT(isPowOfTwo(buf_size));
+	const u32 l = p & (buf_size - 1);
+	if (l + sizeof(value) <= buf_size) {
+		memcpy(&value, buf + l, sizeof(value));
+		return;
+	}
 
-	#pragma pack(1)
-		struct {
-			EventHeader header;
-			T value;
-		} v;
-	#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = timestamp;
-	v.value = value;
+	memcpy(&value, buf + l, buf_size - l);
+	memcpy((u8*)&value + (buf_size - l), buf, sizeof(value) - (buf_size - l));
+}
 
-	MutexGuard lock(ctx.mutex);
+
+// must be called only from the thread owning ctx, or with ctx.mutex locked
+static LUMIX_FORCE_INLINE void writeEvent(ThreadContext& ctx, const EventHeader& header, const void* data, u32 data_size)
+{
 	u8* buf = ctx.buffer.getMutableData();
 	const u32 buf_size = (u32)ctx.buffer.size();
-
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
+	u32 begin = ctx.begin;
+	u32 end = ctx.end;
+
+	if (header.size + end - begin > buf_size) {
+		do {
+			u16 size;
+			read(buf, buf_size, begin, size);
+			begin += size;
+		} while (header.size + end - begin > buf_size);
+		// readers must see the new begin before the evicted events are overwritten
+		ctx.begin = begin;
+		writeBarrier();
 	}
 
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
-	}
+	auto cpy = [&](const void* ptr, u32 size) {
+		const u32 lend = end & (buf_size - 1);
+		if (buf_size - lend >= size) {
+			memcpy(buf + lend, ptr, size);
+		}
+		else {
+			memcpy(buf + lend, ptr, buf_size - lend);
+			memcpy(buf, ((const u8*)ptr) + buf_size - lend, size - (buf_size - lend));
+		}
+		end += size;
+	};
+
+	cpy(&header, sizeof(header));
+	cpy(data, data_size);
+	// event must be complete before readers can see it
+	writeBarrier();
+	ctx.end = end;
+}
 
-	ctx.end += sizeof(v);
-};
 
 template <typename T>
-void write(ThreadContext& ctx, EventType type, const T& value)
+static void write(ThreadContext& ctx, u64 timestamp, EventType type, const T& value)
 {
-	if (g_instance.paused) return;
+	if (g_instance.paused && timestamp > g_instance.paused_time) return;
 
-#pragma pack(1)
-	struct {
-		EventHeader header;
-		T value;
-	} v;
-#pragma pack()
-	v.header.type = type;
-	v.header.size = sizeof(v);
-	v.header.time = os::Timer::getRawTimestamp();
-	v.value = value;
-
-	MutexGuard lock(ctx.mutex);
-	u8* buf = ctx.buffer.getMutableData();
-	const u32 buf_size = (u32)ctx.buffer.size();
+	EventHeader header;
+	header.type = type;
+	header.size = u16(sizeof(header) + sizeof(value));
+	header.time = timestamp;
+	writeEvent(ctx, header, &value, sizeof(value));
+}
 
-	while (sizeof(v) + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
 
-	const u32 lend = ctx.end % buf_size;
-	if (buf_size - lend >= sizeof(v)) {
-		memcpy(buf + lend, &v, sizeof(v));
-	}
-	else {
-		memcpy(buf + lend, &v, buf_size - lend);
-		memcpy(buf, ((u8*)&v) + buf_size - lend, sizeof(v) - (buf_size - lend));
-	}
+template <typename T>
+static void write(ThreadContext& ctx, EventType type, const T& value)
+{
+	if (g_instance.paused) return;
 
-	ctx.end += sizeof(v);
-};
+	EventHeader header;
+	header.type = type;
+	header.size = u16(sizeof(header) + sizeof(value));
+	header.time = os::Timer::getRawTimestamp();
+	writeEvent(ctx, header, &value, sizeof(value));
+}
 
 
-void write(ThreadContext& ctx, EventType type, const u8* data, int size)
+static void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 {
 	if (g_instance.paused) return;
 
@@ -262,32 +431,17 @@ void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 	ASSERT(sizeof(header) + size <= 0xffff);
 	header.size = u16(sizeof(header) + size);
 	header.time = os::Timer::getRawTimestamp();
+	writeEvent(ctx, header, data, size);
+}
 
-	MutexGuard lock(ctx.mutex);
-	u8* buf = ctx.buffer.getMutableData();
-	const u32 buf_size = (u32)ctx.buffer.size();
-
-	while (header.size + ctx.end - ctx.begin > buf_size) {
-		const u8 size = buf[ctx.begin % buf_size];
-		ctx.begin += size;
-	}
-
-	auto cpy = [&](const u8* ptr, u32 size) {
-		const u32 lend = ctx.end % buf_size;
-		if (buf_size - lend >= size) {
-			memcpy(buf + lend, ptr, size);
-		}
-		else {
-			memcpy(buf + lend, ptr, buf_size - lend);
-			memcpy(buf, ((u8*)ptr) + buf_size - lend, size - (buf_size - lend));
-		}
 
-		ctx.end += size;
-	};
+template <typename T>
+static void writeGlobal(EventType type, const T& value)
+{
+	MutexGuard lock(g_instance.global_context.mutex);
+	write(g_instance.global_context, type, value);
+}
 
-	cpy((u8*)&header, sizeof(header));
-	cpy(data, size);
-};
 
 #ifdef _WIN32
 	TraceTask::TraceTask(IAllocator& allocator)
@@ -311,8 +465,201 @@ void write(ThreadContext& ctx, EventType type, const u8* data, int size)
 		rec.new_thread_id = cs->NewThreadId;
 		rec.old_thread_id = cs->OldThreadId;
 		rec.reason = cs->OldThreadWaitReason;
+		MutexGuard lock(g_instance.global_context.mutex);
 		write(g_instance.global_context, rec.timestamp, profiler::EventType::CONTEXT_SWITCH, rec);
 	};
+#else
+	TraceTask::TraceTask(IAllocator& allocator)
+		: Thread(allocator)
+		, buffers(allocator)
+		, records(allocator)
+		, known_threads(allocator)
+	{}
+
+
+	static bool readTracingFile(const char* path, Span<char> content) {
+		const char* roots[] = { "/sys/kernel/tracing/", "/sys/kernel/debug/tracing/" };
+		for (const char* root : roots) {
+			const StaticString<LUMIX_MAX_PATH> full_path(root, path);
+			const int fd = ::open(full_path, O_RDONLY);
+			if (fd < 0) continue;
+			// sysfs files report wrong size, so read until the end
+			u32 size = 0;
+			for (;;) {
+				const ssize_t r = ::read(fd, content.begin() + size, content.length() - size - 1);
+				if (r <= 0) break;
+				size += (u32)r;
+			}
+			::close(fd);
+			content[size] = '\0';
+			return size > 0;
+		}
+		return false;
+	}
+
+
+	static bool getFieldOffset(const char* format, const char* field, u32& offset) {
+		const char* iter = findSubstring(format, field);
+		if (!iter) return false;
+		iter = findSubstring(iter, "offset:");
+		if (!iter) return false;
+		iter += stringLength("offset:");
+		return fromCString(Span(iter, stringLength(iter)), Ref(offset)) != nullptr;
+	}
+
+
+	bool TraceTask::open() {
+		char tmp[4096];
+		u32 id;
+		if (!readTracingFile("events/sched/sched_switch/id", Span(tmp))) return false;
+		if (!fromCString(Span(tmp, stringLength(tmp)), Ref(id))) return false;
+		if (!readTracingFile("events/sched/sched_switch/format", Span(tmp))) return false;
+		if (!getFieldOffset(tmp, " prev_pid;", prev_pid_offset)) return false;
+		if (!getFieldOffset(tmp, " prev_state;", prev_state_offset)) return false;
+		if (!getFieldOffset(tmp, " next_pid;", next_pid_offset)) return false;
+
+		perf_event_attr attr = {};
+		attr.type = PERF_TYPE_TRACEPOINT;
+		attr.size = sizeof(attr);
+		attr.config = id;
+		attr.sample_period = 1;
+		attr.sample_type = PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+		// same clock as os::Timer::getRawTimestamp
+		attr.use_clockid = 1;
+		attr.clockid = CLOCK_MONOTONIC;
+		attr.watermark = 1;
+		page_size = (u32)sysconf(_SC_PAGESIZE);
+		attr.wakeup_watermark = BUFFER_PAGES * page_size / 4;
+
+		const u32 cpus_count = os::getCPUsCount();
+		for (u32 cpu = 0; cpu < cpus_count; ++cpu) {
+			const int fd = (int)syscall(SYS_perf_event_open, &attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+			if (fd < 0) {
+				close();
+				return false;
+			}
+			void* mem = mmap(nullptr, (BUFFER_PAGES + 1) * page_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (mem == MAP_FAILED) {
+				::close(fd);
+				close();
+				return false;
+			}
+			buffers.push({fd, (u8*)mem});
+		}
+		return true;
+	}
+
+
+	void TraceTask::close() {
+		for (CPUBuffer& buffer : buffers) {
+			munmap(buffer.mem, (BUFFER_PAGES + 1) * page_size);
+			::close(buffer.fd);
+		}
+		buffers.clear();
+	}
+
+
+	void TraceTask::updateKnownThreads() {
+		// contexts are never removed
+		MutexGuard lock(g_instance.mutex);
+		if ((u32)g_instance.contexts.size() == (u32)known_threads.size()) return;
+		known_threads.clear();
+		for (const ThreadContext* ctx : g_instance.contexts) {
+			known_threads.push(ctx->thread_id);
+		}
+	}
+
+
+	bool TraceTask::isKnownThread(u32 thread_id) const {
+		for (u32 id : known_threads) {
+			if (id == thread_id) return true;
+		}
+		return false;
+	}
+
+
+	static void copyFromRing(const u8* ring, u64 ring_size, u64 pos, void* dst, u32 size) {
+		const u64 offset = pos & (ring_size - 1);
+		if (offset + size <= ring_size) {
+			memcpy(dst, ring + offset, size);
+			return;
+		}
+		memcpy(dst, ring + offset, ring_size - offset);
+		memcpy((u8*)dst + (ring_size - offset), ring, size - (ring_size - offset));
+	}
+
+
+	// 0 if the thread was preempted, otherwise index of the lowest task state bit + 1 (S, D, T, t, X, Z, P, I)
+	static i8 getSwitchReason(u32 prev_state) {
+		const u32 state = prev_state & 0xff;
+		if (state == 0) return 0;
+		return i8(__builtin_ctz(state) + 1);
+	}
+
+
+	void TraceTask::read(CPUBuffer& buffer) {
+		perf_event_mmap_page* header = (perf_event_mmap_page*)buffer.mem;
+		const u8* ring = buffer.mem + page_size;
+		const u64 ring_size = u64(BUFFER_PAGES) * page_size;
+		const u64 head = __atomic_load_n(&header->data_head, __ATOMIC_ACQUIRE);
+		u64 tail = header->data_tail;
+		while (tail < head) {
+			perf_event_header event;
+			copyFromRing(ring, ring_size, tail, &event, sizeof(event));
+			
+			// sample_type is TIME | RAW, so sample is u64 time, u32 raw size, raw tracepoint data
+			u8 sample[256];
+			const u32 raw_offset = sizeof(event) + sizeof(u64) + sizeof(u32);
+			if (event.type == PERF_RECORD_SAMPLE && event.size <= sizeof(sample) && event.size >= raw_offset + next_pid_offset + sizeof(i32)) {
+				copyFromRing(ring, ring_size, tail, sample, event.size);
+				i32 prev_pid, next_pid;
+				u32 prev_state;
+				ContextSwitchRecord rec;
+				memcpy(&rec.timestamp, sample + sizeof(event), sizeof(rec.timestamp));
+				memcpy(&prev_pid, sample + raw_offset + prev_pid_offset, sizeof(prev_pid));
+				memcpy(&prev_state, sample + raw_offset + prev_state_offset, sizeof(prev_state));
+				memcpy(&next_pid, sample + raw_offset + next_pid_offset, sizeof(next_pid));
+				if (isKnownThread(prev_pid) || isKnownThread(next_pid)) {
+					rec.old_thread_id = prev_pid;
+					rec.new_thread_id = next_pid;
+					rec.reason = getSwitchReason(prev_state);
+					records.push(rec);
+				}
+			}
+			tail += event.size;
+		}
+		__atomic_store_n(&header->data_tail, tail, __ATOMIC_RELEASE);
+	}
+
+
+	int TraceTask::task() {
+		Array<pollfd> fds(g_instance.allocator);
+		for (const CPUBuffer& buffer : buffers) {
+			fds.push({buffer.fd, POLLIN, 0});
+		}
+
+		while (!finished) {
+			// timeout so events are not delayed too much when there are only few of them
+			poll(fds.begin(), fds.size(), 100);
+			updateKnownThreads();
+			records.clear();
+			for (CPUBuffer& buffer : buffers) read(buffer);
+			if (records.empty()) continue;
+
+			// each cpu has its own buffer, merge them so events of a thread are in order
+			qsort(records.begin(), records.size(), sizeof(records[0]), [](const void* a, const void* b) -> int {
+				const u64 ta = ((const ContextSwitchRecord*)a)->timestamp;
+				const u64 tb = ((const ContextSwitchRecord*)b)->timestamp;
+				return ta < tb ? -1 : (ta > tb ? 1 : 0);
+			});
+
+			MutexGuard lock(g_instance.global_context.mutex);
+			for (const ContextSwitchRecord& rec : records) {
+				write(g_instance.global_context, rec.timestamp, profiler::EventType::CONTEXT_SWITCH, rec);
+			}
+		}
+		return 0;
+	}
 #endif
 
 void pushInt(const char* key, int value)
@@ -332,6 +679,44 @@ void pushString(const char* value)
 }
 
 
+void counter(const char* name_literal, double value)
+{
+	MutexGuard lock(g_instance.counters_mutex);
+	for (Instance::Counter& c : g_instance.counters) {
+		if (c.name != name_literal) continue;
+		if (c.count == 0) {
+			c.min = c.max = c.sum = value;
+		}
+		else {
+			c.min = minimum(c.min, value);
+			c.max = maximum(c.max, value);
+			c.sum += value;
+		}
+		++c.count;
+		return;
+	}
+	g_instance.counters.push({name_literal, value, value, value, 1});
+}
+
+
+static void flushCounters()
+{
+	MutexGuard lock(g_instance.counters_mutex);
+	MutexGuard global_lock(g_instance.global_context.mutex);
+	for (Instance::Counter& c : g_instance.counters) {
+		// not set this frame
+		if (c.count == 0) continue;
+		CounterRecord rec;
+		rec.name = c.name;
+		rec.min = c.min;
+		rec.avg = c.sum / c.count;
+		rec.max = c.max;
+		write(g_instance.global_context, EventType::COUNTER, rec);
+		c.count = 0;
+	}
+}
+
+
 void blockColor(u8 r, u8 g, u8 b)
 {
 	const u32 color = 0xff000000 + r + (g << 8) + (b << 16);
@@ -354,7 +739,7 @@ void beginGPUBlock(const char* name, u64 timestamp, i64 profiler_link)
 	data.timestamp = timestamp;
 	copyString(data.name, name);
 	data.profiler_link = profiler_link;
-	write(g_instance.global_context, EventType::BEGIN_GPU_BLOCK, data);
+	writeGlobal(EventType::BEGIN_GPU_BLOCK, data);
 }
 
 void gpuMemStats(u64 total, u64 current, u64 dedicated) {
@@ -362,12 +747,12 @@ void gpuMemStats(u64 total, u64 current, u64 dedicated) {
 	data.total = total;
 	data.current = current;
 	data.dedicated = dedicated;
-	write(g_instance.global_context, EventType::GPU_MEM_STATS, data);
+	writeGlobal(EventType::GPU_MEM_STATS, data);
 }
 
 void endGPUBlock(u64 timestamp)
 {
-	write(g_instance.global_context, EventType::END_GPU_BLOCK, timestamp);
+	writeGlobal(EventType::END_GPU_BLOCK, timestamp);
 }
 
 
@@ -387,7 +772,7 @@ void link(i64 link)
 
 void gpuFrame()
 {
-	write(g_instance.global_context, EventType::GPU_FRAME, (int)0);
+	writeGlobal(EventType::GPU_FRAME, (int)0);
 
 }
 
@@ -477,6 +862,146 @@ bool contextSwitchesEnabled()
 }
 
 
+#ifdef _WIN32
+	bool enableSampling(bool enable, u32 interval_us) {
+		return !enable;
+	}
+
+
+	bool isSamplingEnabled() {
+		return false;
+	}
+
+
+	static void flushSamples() {}
+
+
+	void setFiberStack(const void* begin, const void* end) {}
+#else
+	void setFiberStack(const void* begin, const void* end) {
+		ThreadContext* ctx = g_instance.getThreadContext();
+		// a signal between these writes sees the new begin with the old end, which can not make
+		// the handler read outside the stack it was interrupted on, the other order could
+		ctx->fiber_stack_begin = (const u8*)begin;
+		ctx->fiber_stack_end = (const u8*)end;
+	}
+
+
+	static void sampleSignalHandler(int, siginfo_t*, void* ucontext) {
+		// only async-signal-safe code here, glibc's backtrace is not, so we walk frame pointers of the interrupted code
+		const int saved_errno = errno;
+		ThreadContext* ctx = g_thread_context;
+		if (ctx && ctx->samples) {
+			const mcontext_t& mc = ((const ucontext_t*)ucontext)->uc_mcontext;
+			#if defined(__x86_64__)
+				void* pc = (void*)mc.gregs[REG_RIP];
+				const u8* sp = (const u8*)mc.gregs[REG_RSP];
+				void** fp = (void**)mc.gregs[REG_RBP];
+			#elif defined(__aarch64__)
+				void* pc = (void*)mc.pc;
+				const u8* sp = (const u8*)mc.sp;
+				void** fp = (void**)mc.regs[29];
+			#endif
+
+			const u8* stack_end = nullptr;
+			if (sp >= ctx->thread_stack_begin && sp < ctx->thread_stack_end) {
+				stack_end = ctx->thread_stack_end;
+			}
+			else {
+				const u8* fiber_begin = ctx->fiber_stack_begin;
+				const u8* fiber_end = ctx->fiber_stack_end;
+				if (sp >= fiber_begin && sp < fiber_end) stack_end = fiber_end;
+			}
+
+			Sample sample;
+			sample.frames[0] = pc;
+			sample.frames_count = 1;
+			// fp[0] is caller's fp, fp[1] is return address, each frame is above the previous one
+			const u8* low = sp;
+			while (sample.frames_count < MAX_SAMPLE_FRAMES) {
+				if ((const u8*)fp < low || (const u8*)(fp + 2) > stack_end || ((uintptr)fp & (sizeof(void*) - 1))) break;
+				if (!fp[1]) break;
+				sample.frames[sample.frames_count++] = fp[1];
+				low = (const u8*)(fp + 2);
+				fp = (void**)fp[0];
+			}
+			// sample is dropped if the queue is full
+			ctx->samples->tryPush(sample);
+		}
+		errno = saved_errno;
+	}
+
+
+	bool enableSampling(bool enable, u32 interval_us) {
+		MutexGuard lock(g_instance.mutex);
+		if (!enable) {
+			g_instance.sampling_interval_us = 0;
+			for (ThreadContext* ctx : g_instance.contexts) g_instance.stopSampling(*ctx);
+			return true;
+		}
+
+		if (interval_us == 0) return false;
+		if (!g_instance.sampling_handler_installed) {
+			struct sigaction action = {};
+			action.sa_sigaction = &sampleSignalHandler;
+			action.sa_flags = SA_SIGINFO | SA_RESTART;
+			sigemptyset(&action.sa_mask);
+			if (sigaction(SIGPROF, &action, nullptr) != 0) return false;
+			g_instance.sampling_handler_installed = true;
+		}
+
+		for (ThreadContext* ctx : g_instance.contexts) g_instance.stopSampling(*ctx);
+		g_instance.sampling_interval_us = interval_us;
+		for (ThreadContext* ctx : g_instance.contexts) g_instance.startSampling(*ctx);
+		return true;
+	}
+
+
+	bool isSamplingEnabled() {
+		return g_instance.sampling_interval_us != 0;
+	}
+
+
+	// aggregates samples collected since last frame by thread and call stack
+	static void flushSamples() {
+		MutexGuard lock(g_instance.mutex);
+		Sample sample;
+		for (ThreadContext* ctx : g_instance.contexts) {
+			if (!ctx->samples) continue;
+
+			g_instance.sample_map.clear();
+			g_instance.unique_samples.clear();
+			g_instance.sample_counts.clear();
+			while (ctx->samples->tryPop(sample)) {
+				const u64 hash = hash64(sample.frames, sample.frames_count * sizeof(void*));
+				auto iter = g_instance.sample_map.find(hash);
+				if (iter.isValid()) {
+					++g_instance.sample_counts[iter.value()];
+					continue;
+				}
+				g_instance.sample_map.insert(hash, g_instance.unique_samples.size());
+				g_instance.unique_samples.push(sample);
+				g_instance.sample_counts.push(1);
+			}
+			if (g_instance.unique_samples.empty()) continue;
+
+			MutexGuard global_lock(g_instance.global_context.mutex);
+			for (u32 i = 0, c = g_instance.unique_samples.size(); i < c; ++i) {
+				const Sample& s = g_instance.unique_samples[i];
+				u8 data[sizeof(SampleRecord) + sizeof(s.frames)];
+				SampleRecord rec;
+				rec.thread_id = ctx->thread_id;
+				rec.count = g_instance.sample_counts[i];
+				rec.frames_count = s.frames_count;
+				memcpy(data, &rec, sizeof(rec));
+				memcpy(data + sizeof(rec), s.frames, s.frames_count * sizeof(void*));
+				write(g_instance.global_context, EventType::SAMPLES, data, int(sizeof(rec) + s.frames_count * sizeof(void*)));
+			}
+		}
+	}
+#endif
+
+
 void frame()
 {
 	const u64 n = os::Timer::getRawTimestamp();
@@ -484,7 +1009,9 @@ void frame()
 		g_instance.last_frame_duration = n - g_instance.last_frame_time;
 	}
 	g_instance.last_frame_time = n;
-	write(g_instance.global_context, EventType::FRAME, 0);
+	flushSamples();
+	flushCounters();
+	writeGlobal(EventType::FRAME, 0);
 }
 
 
@@ -505,34 +1032,31 @@ void setThreadName(const char* name)
 	ctx->name = name;
 }
 
-template <typename T>
-static void read(const ThreadContext& ctx, u32 p, T& value)
-{
-	const u8* buf = ctx.buffer.data();
-	const u32 buf_size = (u32)ctx.buffer.size();
-	const u32 l = p % buf_size;
-	if (l + sizeof(value) <= buf_size) {
-		memcpy(&value, buf + l, sizeof(value));
-		return;
-	}
+// copy of a ring buffer in serialized blob
+struct Snapshot {
+	u32 begin;
+	u32 end;
+	u32 buffer_size;
+	u64 buffer_offset;
+	u32 thread_id;
+	StaticString<64> name;
+};
 
-	memcpy(&value, buf + l, buf_size - l);
-	memcpy((u8*)&value + (buf_size - l), buf, sizeof(value) - (buf_size - l));
-}
 
-static void saveStrings(OutputMemoryStream& blob) {
+static void saveStrings(OutputMemoryStream& blob, Span<const Snapshot> snapshots) {
 	HashMap<const char*, const char*> map(g_instance.allocator);
 	map.reserve(512);
-	auto gather = [&](const ThreadContext& ctx){
-		u32 p = ctx.begin;
-		const u32 end = ctx.end;
-		while (p != end) {
+	for (const Snapshot& snapshot : snapshots) {
+		const u8* buf = blob.data() + snapshot.buffer_offset;
+		const u32 buf_size = snapshot.buffer_size;
+		u32 p = snapshot.begin;
+		while (p != snapshot.end) {
 			profiler::EventHeader header;
-			read(ctx, p, header);
+			read(buf, buf_size, p, header);
 			switch (header.type) {
 				case profiler::EventType::BEGIN_BLOCK: {
 					const char* name;
-					read(ctx, p + sizeof(profiler::EventHeader), name);
+					read(buf, buf_size, p + sizeof(profiler::EventHeader), name);
 					if (!map.find(name).isValid()) {
 						map.insert(name, name);
 					}
@@ -540,21 +1064,24 @@ static void saveStrings(OutputMemoryStream& blob) {
 				}
 				case profiler::EventType::INT: {
 					IntRecord r;
-					read(ctx, p + sizeof(profiler::EventHeader), r);
+					read(buf, buf_size, p + sizeof(profiler::EventHeader), r);
 					if (!map.find(r.key).isValid()) {
 						map.insert(r.key, r.key);
 					}
 					break;
 				}
+				case profiler::EventType::COUNTER: {
+					CounterRecord r;
+					read(buf, buf_size, p + sizeof(profiler::EventHeader), r);
+					if (!map.find(r.name).isValid()) {
+						map.insert(r.name, r.name);
+					}
+					break;
+				}
 				default: break;
 			}
 			p += header.size;
 		}
-	};
-
-	gather(g_instance.global_context);
-	for (const ThreadContext* ctx : g_instance.contexts) {
-		gather(*ctx);
 	}
 
 	blob.write(map.size());
@@ -564,26 +1091,404 @@ static void saveStrings(OutputMemoryStream& blob) {
 	}
 }
 
-void serialize(OutputMemoryStream& blob, ThreadContext& ctx) {
-	MutexGuard lock(ctx.mutex);
-	blob.writeString(ctx.name);
+// writers are not blocked, events overwritten while the buffer is copied are dropped from the snapshot
+static Snapshot serialize(OutputMemoryStream& blob, ThreadContext& ctx) {
+	Snapshot snapshot;
+	{
+		MutexGuard lock(ctx.mutex);
+		snapshot.name = ctx.name;
+	}
+	snapshot.thread_id = ctx.thread_id;
+	blob.writeString(snapshot.name);
 	blob.write(ctx.thread_id);
-	blob.write(ctx.begin);
-	blob.write(ctx.end);
+	// begin and end are patched after the buffer is copied
+	const u64 range_offset = blob.size();
+	blob.write<u32>(0);
+	blob.write<u32>(0);
 	blob.write((u8)ctx.show_in_profiler);
-	blob.write((u32)ctx.buffer.size());
+
+	snapshot.buffer_size = (u32)ctx.buffer.size();
+	blob.write(snapshot.buffer_size);
+	snapshot.buffer_offset = blob.size();
+	
+	snapshot.end = ctx.end;
+	readBarrier();
 	blob.write(ctx.buffer.data(), ctx.buffer.size());
+	readBarrier();
+	// anything before begin could be overwritten during the copy
+	snapshot.begin = ctx.begin;
+	if (i32(snapshot.end - snapshot.begin) < 0) snapshot.begin = snapshot.end;
+
+	memcpy(blob.getMutableData() + range_offset, &snapshot.begin, sizeof(snapshot.begin));
+	memcpy(blob.getMutableData() + range_offset + sizeof(snapshot.begin), &snapshot.end, sizeof(snapshot.end));
+	return snapshot;
 }
 
-void serialize(OutputMemoryStream& blob) {
+// first snapshot is the global context
+static void serializeContexts(OutputMemoryStream& blob, Array<Snapshot>& snapshots) {
 	MutexGuard lock(g_instance.mutex);
+	snapshots.reserve(g_instance.contexts.size() + 1);
 	blob.write<u32>(0); // version
 	blob.write((u32)g_instance.contexts.size());
-	serialize(blob, g_instance.global_context);
+	snapshots.push(serialize(blob, g_instance.global_context));
 	for (ThreadContext* ctx : g_instance.contexts) {
-		serialize(blob, *ctx);
+		snapshots.push(serialize(blob, *ctx));
 	}	
-	saveStrings(blob);
+}
+
+void serialize(OutputMemoryStream& blob) {
+	Array<Snapshot> snapshots(g_instance.allocator);
+	serializeContexts(blob, snapshots);
+	saveStrings(blob, snapshots);
+}
+
+
+// https://docs.google.com/document/d/1CvAClvFfyA5R-PhYUmn5OOQtYMH4h6I0nSsKchNAySU
+struct ChromeTraceWriter {
+	// global context events (frames, gpu) are put on this track
+	static constexpr u32 GPU_TID = 0;
+
+	ChromeTraceWriter(IOutputStream& out, u64 base_time)
+		: out(out)
+		, base_time(base_time)
+		, ns_per_tick(1e9 / double(frequency()))
+	{}
+
+	// microseconds with ns precision
+	void time(u64 t) {
+		const u64 ns = t > base_time ? u64((t - base_time) * ns_per_tick) : 0;
+		const u32 frac = u32(ns % 1000);
+		out << ",\"ts\":" << ns / 1000 << (frac < 100 ? (frac < 10 ? ".00" : ".0") : ".") << frac;
+	}
+
+	// caller writes the rest of the event and the closing brace
+	void event(const char* phase, const char* name, u32 tid, u64 t) {
+		out << (first ? "\n{\"ph\":\"" : ",\n{\"ph\":\"") << phase << "\",\"pid\":0,\"tid\":" << tid << ",\"name\":";
+		writeJSONString(out, name);
+		time(t);
+		first = false;
+	}
+
+	void threadName(u32 tid, const char* name) {
+		out << (first ? "\n" : ",\n") << "{\"ph\":\"M\",\"pid\":0,\"tid\":" << tid << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+		writeJSONString(out, name);
+		out << "}}";
+		first = false;
+	}
+
+	IOutputStream& out;
+	u64 base_time;
+	double ns_per_tick;
+	bool first = true;
+};
+
+
+struct ChromeTraceThread {
+	struct Block {
+		const char* name;
+		u64 start;
+		u32 args_offset;
+		u32 strings_count;
+	};
+
+	ChromeTraceThread(ChromeTraceWriter& writer, u32 tid, IAllocator& allocator)
+		: writer(writer)
+		, tid(tid)
+		, args(allocator)
+	{}
+
+	// blocks opened before `from` are written once the first event in range is found
+	void flushOpenBlocks(u64 from) {
+		for (i32 i = written_level + 1; i <= level; ++i) {
+			writer.event("B", stack[i].name, tid, maximum(stack[i].start, from));
+			writer.out << "}";
+		}
+		written_level = level;
+	}
+
+	void beginBlock(const char* name, u64 time) {
+		// blocks deeper than the stack are dropped, but their ends must not pop the parents
+		if (level + 1 == (i32)lengthOf(stack)) {
+			++overflow;
+			return;
+		}
+		++level;
+		stack[level].name = name;
+		stack[level].start = time;
+		stack[level].args_offset = (u32)args.size();
+		stack[level].strings_count = 0;
+	}
+
+	// args are written in end event, chrome merges them with the begin event
+	void endBlock(u64 time) {
+		if (overflow > 0) {
+			--overflow;
+			return;
+		}
+		if (level < 0) return;
+		if (level <= written_level) {
+			writer.event("E", stack[level].name, tid, time);
+			if (args.size() > stack[level].args_offset) {
+				writer.out << ",\"args\":{";
+				writer.out.write(args.data() + stack[level].args_offset + 1, args.size() - stack[level].args_offset - 1);
+				writer.out << "}";
+			}
+			writer.out << "}";
+			written_level = level - 1;
+		}
+		args.resize(stack[level].args_offset);
+		--level;
+	}
+
+	template <typename T>
+	void arg(const char* key, T value) {
+		if (level < 0 || overflow > 0) return;
+		args << ",\"" << key << "\":" << value;
+	}
+
+	void stringArg(const char* value) {
+		if (level < 0 || overflow > 0) return;
+		args << ",\"string " << stack[level].strings_count << "\":";
+		++stack[level].strings_count;
+		writeJSONString(args, value);
+	}
+
+	ChromeTraceWriter& writer;
+	u32 tid;
+	Block stack[64];
+	i32 level = -1;
+	i32 written_level = -1;
+	u32 overflow = 0;
+	OutputMemoryStream args;
+};
+
+void exportChromeTrace(IOutputStream& out, u64 from, u64 to) {
+	OutputMemoryStream blob(g_instance.allocator);
+	Array<Snapshot> snapshots(g_instance.allocator);
+	serializeContexts(blob, snapshots);
+
+	ChromeTraceWriter writer(out, from);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	writer.threadName(ChromeTraceWriter::GPU_TID, "GPU");
+	for (u32 i = 1; i < (u32)snapshots.size(); ++i) {
+		const Snapshot& s = snapshots[i];
+		writer.threadName(s.thread_id, s.name[0] ? s.name.data : "Unnamed thread");
+	}
+
+	auto isKnownThread = [&](u32 thread_id){
+		for (u32 i = 1; i < (u32)snapshots.size(); ++i) {
+			if (snapshots[i].thread_id == thread_id) return true;
+		}
+		return false;
+	};
+
+	for (u32 i = 1; i < (u32)snapshots.size(); ++i) {
+		const Snapshot& s = snapshots[i];
+		const u8* buf = blob.data() + s.buffer_offset;
+		ChromeTraceThread thread(writer, s.thread_id, g_instance.allocator);
+		u64 last_time = from;
+		for (u32 p = s.begin; p != s.end;) {
+			EventHeader header;
+			read(buf, s.buffer_size, p, header);
+			const u32 data_pos = p + sizeof(header);
+			p += header.size;
+			if (header.time > to) break;
+
+			const bool in_range = header.time >= from;
+			if (in_range) {
+				thread.flushOpenBlocks(from);
+				last_time = header.time;
+			}
+			switch (header.type) {
+				case EventType::BEGIN_BLOCK: {
+					const char* name;
+					read(buf, s.buffer_size, data_pos, name);
+					thread.beginBlock(name, header.time);
+					if (in_range) thread.flushOpenBlocks(from);
+					break;
+				}
+				case EventType::END_BLOCK:
+					thread.endBlock(header.time);
+					break;
+				case EventType::INT: {
+					IntRecord r;
+					read(buf, s.buffer_size, data_pos, r);
+					thread.arg(r.key, r.value);
+					break;
+				}
+				case EventType::STRING: {
+					char tmp[256];
+					const u32 len = minimum(header.size - (u32)sizeof(header), (u32)sizeof(tmp));
+					for (u32 j = 0; j < len; ++j) read(buf, s.buffer_size, data_pos + j, tmp[j]);
+					tmp[len - 1] = '\0';
+					thread.stringArg(tmp);
+					break;
+				}
+				case EventType::JOB_INFO: {
+					JobRecord r;
+					read(buf, s.buffer_size, data_pos, r);
+					if (r.signal_on_finish != 0xffFFffFF) thread.arg("signal_on_finish", r.signal_on_finish);
+					if (r.precondition != 0xffFFffFF) thread.arg("precondition", r.precondition);
+					break;
+				}
+				case EventType::LINK: {
+					i64 link;
+					read(buf, s.buffer_size, data_pos, link);
+					thread.arg("link", link);
+					if (in_range && thread.level >= 0) {
+						writer.event("s", "gpu", s.thread_id, header.time);
+						out << ",\"cat\":\"link\",\"id\":" << link << "}";
+					}
+					break;
+				}
+				case EventType::BEGIN_FIBER_WAIT:
+				case EventType::END_FIBER_WAIT: {
+					if (!in_range) break;
+					FiberWaitRecord r;
+					read(buf, s.buffer_size, data_pos, r);
+					// fiber can continue on another thread, flow arrow connects both ends of the wait
+					const bool is_begin = header.type == EventType::BEGIN_FIBER_WAIT;
+					writer.event("i", is_begin ? "fiber wait" : "fiber resume", s.thread_id, header.time);
+					out << ",\"s\":\"t\",\"args\":{\"signal\":" << r.job_system_signal << ",\"id\":" << r.id << "}}";
+					writer.event(is_begin ? "s" : "f", "fiber", s.thread_id, header.time);
+					out << ",\"cat\":\"fiber\",\"id\":" << r.id << "}";
+					break;
+				}
+				default: break;
+			}
+		}
+		// blocks still running at the end of the range
+		while (thread.level >= 0) thread.endBlock(maximum(last_time, minimum(to, os::Timer::getRawTimestamp())));
+	}
+
+	const Snapshot& global = snapshots[0];
+	const u8* buf = blob.data() + global.buffer_offset;
+	// gpu blocks are nested, true if the block is in range and its begin was written
+	bool gpu_blocks[64];
+	i32 gpu_level = -1;
+	u32 gpu_overflow = 0;
+	for (u32 p = global.begin; p != global.end;) {
+		EventHeader header;
+		read(buf, global.buffer_size, p, header);
+		const u32 data_pos = p + sizeof(header);
+		p += header.size;
+
+		switch (header.type) {
+			case EventType::BEGIN_GPU_BLOCK: {
+				if (gpu_level + 1 == (i32)lengthOf(gpu_blocks)) {
+					++gpu_overflow;
+					break;
+				}
+				GPUBlock block;
+				read(buf, global.buffer_size, data_pos, block);
+				++gpu_level;
+				gpu_blocks[gpu_level] = block.timestamp >= from && block.timestamp <= to;
+				if (!gpu_blocks[gpu_level]) break;
+
+				writer.event("B", block.name, ChromeTraceWriter::GPU_TID, block.timestamp);
+				out << "}";
+				if (block.profiler_link) {
+					writer.event("f", "gpu", ChromeTraceWriter::GPU_TID, block.timestamp);
+					out << ",\"cat\":\"link\",\"bp\":\"e\",\"id\":" << block.profiler_link << "}";
+				}
+				break;
+			}
+			case EventType::END_GPU_BLOCK: {
+				if (gpu_overflow > 0) {
+					--gpu_overflow;
+					break;
+				}
+				if (gpu_level < 0) break;
+				u64 timestamp;
+				read(buf, global.buffer_size, data_pos, timestamp);
+				if (gpu_blocks[gpu_level]) {
+					writer.event("E", "", ChromeTraceWriter::GPU_TID, minimum(timestamp, to));
+					out << "}";
+				}
+				--gpu_level;
+				break;
+			}
+			case EventType::GPU_MEM_STATS: {
+				if (header.time < from || header.time > to) break;
+				GPUMemStatsBlock stats;
+				read(buf, global.buffer_size, data_pos, stats);
+				writer.event("C", "GPU memory (MB)", ChromeTraceWriter::GPU_TID, header.time);
+				out << ",\"args\":{\"used\":" << (stats.total - stats.current) / (1024 * 1024) << ",\"total\":" << stats.total / (1024 * 1024) << "}}";
+				break;
+			}
+			case EventType::COUNTER: {
+				if (header.time < from || header.time > to) break;
+				CounterRecord r;
+				read(buf, global.buffer_size, data_pos, r);
+				writer.event("C", r.name, ChromeTraceWriter::GPU_TID, header.time);
+				out << ",\"args\":{\"min\":" << r.min << ",\"avg\":" << r.avg << ",\"max\":" << r.max << "}}";
+				break;
+			}
+			case EventType::FRAME:
+				if (header.time < from || header.time > to) break;
+				writer.event("i", "frame", ChromeTraceWriter::GPU_TID, header.time);
+				out << ",\"s\":\"g\"}";
+				break;
+			case EventType::CONTEXT_SWITCH: {
+				if (header.time < from || header.time > to) break;
+				ContextSwitchRecord r;
+				read(buf, global.buffer_size, data_pos, r);
+				if (isKnownThread(r.old_thread_id)) {
+					writer.event("i", "switched out", r.old_thread_id, header.time);
+					out << ",\"s\":\"t\",\"args\":{\"reason\":" << (i32)r.reason << "}}";
+				}
+				if (isKnownThread(r.new_thread_id)) {
+					writer.event("i", "switched in", r.new_thread_id, header.time);
+					out << ",\"s\":\"t\"}";
+				}
+				break;
+			}
+			default: break;
+		}
+	}
+	out << "\n]}\n";
+}
+
+void forEachBlock(u64 from, u64 to, void* user_ptr, void (*callback)(void* user_ptr, const char* name, u64 start, u64 end)) {
+	OutputMemoryStream blob(g_instance.allocator);
+	Array<Snapshot> snapshots(g_instance.allocator);
+	serializeContexts(blob, snapshots);
+
+	for (u32 i = 1; i < (u32)snapshots.size(); ++i) {
+		const Snapshot& s = snapshots[i];
+		const u8* buf = blob.data() + s.buffer_offset;
+		struct {
+			const char* name;
+			u64 start;
+		} stack[64];
+		i32 level = -1;
+		for (u32 p = s.begin; p != s.end;) {
+			EventHeader header;
+			read(buf, s.buffer_size, p, header);
+			const u32 data_pos = p + sizeof(header);
+			p += header.size;
+			if (header.time > to) break;
+
+			switch (header.type) {
+				case EventType::BEGIN_BLOCK:
+					++level;
+					if (level < (i32)lengthOf(stack)) {
+						read(buf, s.buffer_size, data_pos, stack[level].name);
+						stack[level].start = header.time;
+					}
+					break;
+				case EventType::END_BLOCK:
+					// begin could be already overwritten
+					if (level < 0) break;
+					if (level < (i32)lengthOf(stack) && header.time >= from) {
+						callback(user_ptr, stack[level].name, stack[level].start, header.time);
+					}
+					--level;
+					break;
+				default: break;
+			}
+		}
+	}
 }
 
 void pause(bool paused)
@@ -4,6 +4,7 @@
 
 namespace Lumix {
 
+struct IOutputStream;
 struct OutputMemoryStream;
 
 namespace profiler {
@@ -21,6 +22,8 @@ LUMIX_ENGINE_API void frame();
 LUMIX_ENGINE_API void pushJobInfo(u32 signal_on_finish, u32 precondition);
 LUMIX_ENGINE_API void pushString(const char* value);
 LUMIX_ENGINE_API void pushInt(const char* key_literal, int value);
+// frame-level metric, values set during a frame are aggregated to min/avg/max and recorded in frame()
+LUMIX_ENGINE_API void counter(const char* name_literal, double value);
 
 LUMIX_ENGINE_API void beginGPUBlock(const char* name, u64 timestamp, i64 profiler_link);
 LUMIX_ENGINE_API void endGPUBlock(u64 timestamp);
@@ -29,6 +32,11 @@ LUMIX_ENGINE_API void gpuFrame();
 LUMIX_ENGINE_API void link(i64 link);
 LUMIX_ENGINE_API i64 createNewLinkID();
 LUMIX_ENGINE_API void serialize(OutputMemoryStream& blob);
+// events in [from, to] (raw timestamps) in Chrome Trace Event format, can be opened in chrome://tracing or ui.perfetto.dev
+LUMIX_ENGINE_API void exportChromeTrace(IOutputStream& out, u64 from, u64 to);
+// calls callback for every CPU block which ended in [from, to], on all threads
+// blocks interrupted by fiber switches are reported as several blocks
+LUMIX_ENGINE_API void forEachBlock(u64 from, u64 to, void* user_ptr, void (*callback)(void* user_ptr, const char* name, u64 start, u64 end));
 
 struct FiberSwitchData {
 	i32 id;
@@ -36,7 +44,14 @@ struct FiberSwitchData {
 	u32 count;
 };
 
+// samples call stacks of all threads every interval_us of their cpu time, samples are aggregated per frame
+// only on Linux, returns false if sampling can not be enabled
+LUMIX_ENGINE_API bool enableSampling(bool enable, u32 interval_us = 1000);
+LUMIX_ENGINE_API bool isSamplingEnabled();
+
 LUMIX_ENGINE_API void beforeFiberSwitch();
+// stack of the fiber the thread switches to, null for the thread's own stack; sampling does not read memory outside it
+LUMIX_ENGINE_API void setFiberStack(const void* begin, const void* end);
 LUMIX_ENGINE_API FiberSwitchData beginFiberWait(u32 job_system_signal);
 LUMIX_ENGINE_API void endFiberWait(u32 job_system_signal, const FiberSwitchData& switch_data);
 LUMIX_ENGINE_API float getLastFrameDuration();
@@ -70,6 +85,25 @@ struct IntRecord
 };
 
 
+struct CounterRecord
+{
+	const char* name;
+	double min;
+	double avg;
+	double max;
+};
+
+
+// all samples of a thread with the same call stack during a frame
+// followed by frames_count return addresses, innermost first
+struct SampleRecord
+{
+	u32 thread_id;
+	u32 count;
+	u32 frames_count;
+};
+
+
 struct JobRecord
 {
 	u32 signal_on_finish;
@@ -115,7 +149,9 @@ enum class EventType : u8
 	END_GPU_BLOCK,
 	GPU_FRAME,
 	GPU_MEM_STATS,
-	LINK
+	LINK,
+	SAMPLES,
+	COUNTER
 };
 
 #pragma pack(1)
@@ -2,6 +2,8 @@
 
 
 #include "engine/allocator.h"
+#include "engine/atomic.h"
+#include "engine/sync.h"
 
 
 namespace Lumix
@@ -84,4 +86,259 @@ namespace Lumix
 		T* m_buffer = (T*)m_mem;
 		alignas(T) u8 m_mem[sizeof(T) * COUNT];
 	};
+
+	// bounded lock-free queue, push only from one thread and pop only from one (other) thread
+	template <typename T, u32 COUNT>
+	struct SPSCQueue
+	{
+		static_assert(COUNT && !(COUNT & (COUNT - 1)), "Is not power of 2");
+	public:
+		using Value = T;
+
+		SPSCQueue() = default;
+		SPSCQueue(const SPSCQueue&) = delete;
+		void operator =(const SPSCQueue&) = delete;
+
+		~SPSCQueue() {
+			for (u32 i = m_rd; i != m_wr; ++i) {
+				slot(i)->~T();
+			}
+		}
+
+		// returns false if the queue is full
+		bool tryPush(const T& item) {
+			const u32 wr = m_wr;
+			if (!reserveWrite(wr)) return false;
+			new (NewPlaceholder(), slot(wr)) T(item);
+			writeBarrier();
+			m_wr = wr + 1;
+			return true;
+		}
+
+		bool tryPush(T&& item) {
+			const u32 wr = m_wr;
+			if (!reserveWrite(wr)) return false;
+			new (NewPlaceholder(), slot(wr)) T(static_cast<T&&>(item));
+			writeBarrier();
+			m_wr = wr + 1;
+			return true;
+		}
+
+		// returns false if the queue is empty
+		bool tryPop(T& out) {
+			const u32 rd = m_rd;
+			if (rd == m_cached_wr) {
+				m_cached_wr = m_wr;
+				if (rd == m_cached_wr) return false;
+			}
+			readBarrier();
+			T* item = slot(rd);
+			out = static_cast<T&&>(*item);
+			item->~T();
+			writeBarrier();
+			m_rd = rd + 1;
+			return true;
+		}
+
+		// only a hint when called from other threads
+		bool empty() const { return m_rd == m_wr; }
+
+	private:
+		T* slot(u32 idx) { return (T*)m_mem + (idx & (COUNT - 1)); }
+
+		bool reserveWrite(u32 wr) {
+			if (wr - m_cached_rd < COUNT) return true;
+			m_cached_rd = m_rd;
+			readBarrier();
+			return wr - m_cached_rd < COUNT;
+		}
+
+		// producer and consumer data are on separate cache lines, m_cached_* avoid reading the other one's line
+		alignas(64) volatile u32 m_wr = 0;
+		u32 m_cached_rd = 0;
+		alignas(64) volatile u32 m_rd = 0;
+		u32 m_cached_wr = 0;
+		alignas(64) alignas(T) u8 m_mem[sizeof(T) * COUNT];
+	};
+
+
+	// bounded lock-free queue, any number of producers and consumers
+	// each slot has a sequence number telling whether it's ready to be written or read in the current lap
+	// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+	template <typename T, u32 COUNT>
+	struct MPMCQueue
+	{
+		static_assert(COUNT && !(COUNT & (COUNT - 1)), "Is not power of 2");
+	public:
+		using Value = T;
+
+		MPMCQueue() {
+			for (u32 i = 0; i < COUNT; ++i) m_slots[i].seq = i;
+		}
+
+		MPMCQueue(const MPMCQueue&) = delete;
+		void operator =(const MPMCQueue&) = delete;
+
+		~MPMCQueue() {
+			for (i32 i = m_rd; i != m_wr; ++i) {
+				((T*)m_slots[i & (COUNT - 1)].mem)->~T();
+			}
+		}
+
+		// returns false if the queue is full
+		bool tryPush(const T& item) {
+			Slot* slot = reserveWrite();
+			if (!slot) return false;
+			new (NewPlaceholder(), slot->mem) T(item);
+			publishWrite(*slot);
+			return true;
+		}
+
+		bool tryPush(T&& item) {
+			Slot* slot = reserveWrite();
+			if (!slot) return false;
+			new (NewPlaceholder(), slot->mem) T(static_cast<T&&>(item));
+			publishWrite(*slot);
+			return true;
+		}
+
+		// returns false if the queue is empty
+		bool tryPop(T& out) {
+			i32 pos = m_rd;
+			for (;;) {
+				Slot& slot = m_slots[pos & (COUNT - 1)];
+				const i32 diff = slot.seq - (pos + 1);
+				if (diff == 0) {
+					if (compareAndExchange(&m_rd, pos + 1, pos)) {
+						readBarrier();
+						T* item = (T*)slot.mem;
+						out = static_cast<T&&>(*item);
+						item->~T();
+						writeBarrier();
+						slot.seq = pos + COUNT;
+						return true;
+					}
+				}
+				else if (diff < 0) {
+					return false;
+				}
+				pos = m_rd;
+			}
+		}
+
+		// only a hint
+		bool empty() const { return m_rd == m_wr; }
+
+	private:
+		struct Slot {
+			volatile i32 seq;
+			alignas(T) u8 mem[sizeof(T)];
+		};
+
+		Slot* reserveWrite() {
+			i32 pos = m_wr;
+			for (;;) {
+				Slot& slot = m_slots[pos & (COUNT - 1)];
+				const i32 diff = slot.seq - pos;
+				if (diff == 0) {
+					if (compareAndExchange(&m_wr, pos + 1, pos)) return &slot;
+				}
+				else if (diff < 0) {
+					return nullptr;
+				}
+				pos = m_wr;
+			}
+		}
+
+		void publishWrite(Slot& slot) {
+			writeBarrier();
+			slot.seq = slot.seq + 1;
+		}
+
+		alignas(64) volatile i32 m_wr = 0;
+		alignas(64) volatile i32 m_rd = 0;
+		alignas(64) Slot m_slots[COUNT];
+	};
+
+
+	// adds blocking push and pop to SPSCQueue or MPMCQueue, threads sleep on a semaphore only if they have to wait
+	template <typename Q>
+	struct BlockingQueue
+	{
+		using T = typename Q::Value;
+
+		BlockingQueue()
+			: m_pop_semaphore(0, 0x7fffFFFF)
+			, m_push_semaphore(0, 0x7fffFFFF)
+		{}
+
+		bool tryPush(const T& item) {
+			if (!m_queue.tryPush(item)) return false;
+			wake(m_pop_waiting, m_pop_semaphore);
+			return true;
+		}
+
+		bool tryPop(T& out) {
+			if (!m_queue.tryPop(out)) return false;
+			wake(m_push_waiting, m_push_semaphore);
+			return true;
+		}
+
+		// waits while the queue is full
+		void push(const T& item) {
+			for (;;) {
+				if (tryPush(item)) return;
+				atomicIncrement(&m_push_waiting);
+				if (m_queue.tryPush(item)) {
+					cancelWait(m_push_waiting, m_push_semaphore);
+					wake(m_pop_waiting, m_pop_semaphore);
+					return;
+				}
+				m_push_semaphore.wait();
+			}
+		}
+
+		// waits while the queue is empty
+		void pop(T& out) {
+			for (;;) {
+				if (tryPop(out)) return;
+				atomicIncrement(&m_pop_waiting);
+				if (m_queue.tryPop(out)) {
+					cancelWait(m_pop_waiting, m_pop_semaphore);
+					wake(m_push_waiting, m_push_semaphore);
+					return;
+				}
+				m_pop_semaphore.wait();
+			}
+		}
+
+		bool empty() const { return m_queue.empty(); }
+
+	private:
+		static bool decrementIfPositive(volatile i32& value) {
+			for (;;) {
+				const i32 v = value;
+				if (v <= 0) return false;
+				if (compareAndExchange(&value, v - 1, v)) return true;
+			}
+		}
+
+		// each successful decrement of waiting counter is paired with exactly one signal
+		static void wake(volatile i32& waiting, Semaphore& semaphore) {
+			// make the pushed/popped item visible before checking for waiters
+			memoryBarrier();
+			if (waiting > 0 && decrementIfPositive(waiting)) semaphore.signal();
+		}
+
+		static void cancelWait(volatile i32& waiting, Semaphore& semaphore) {
+			// somebody already decremented the counter for us and signaled, consume the signal
+			if (!decrementIfPositive(waiting)) semaphore.wait();
+		}
+
+		Q m_queue;
+		volatile i32 m_pop_waiting = 0;
+		volatile i32 m_push_waiting = 0;
+		Semaphore m_pop_semaphore;
+		Semaphore m_push_semaphore;
+	};
 }
@@ -33,7 +33,10 @@ Resource::Resource(const Path& path, ResourceManager& resource_manager, IAllocat
 }
 
 
-Resource::~Resource() = default;
+Resource::~Resource()
+{
+	m_resource_manager.m_resident_size -= m_size;
+}
 
 
 void Resource::refresh() {
@@ -120,9 +123,12 @@ void Resource::fileLoaded(u64 size, const u8* mem, bool success)
 		return;
 	}
 
+	// m_size is set by load
+	const u64 prev_size = m_size;
 	if (!load(size, mem)) {
 		++m_failed_dep_count;
 	}
+	m_resource_manager.m_resident_size += m_size - prev_size;
 
 	ASSERT(m_empty_dep_count > 0);
 	--m_empty_dep_count;
@@ -144,6 +150,7 @@ void Resource::doUnload()
 	unload();
 	ASSERT(m_empty_dep_count <= 1);
 
+	m_resource_manager.m_resident_size -= m_size;
 	m_size = 0;
 	m_empty_dep_count = 1;
 	m_failed_dep_count = 0;
@@ -177,7 +184,7 @@ void Resource::doLoad()
 	const u32 hash = m_path.getHash();
 	const StaticString<LUMIX_MAX_PATH> res_path(".lumix/assets/", hash, ".res");
 
-	m_async_op = fs.getContent(Path(res_path), cb);
+	m_async_op = fs.getContent(Path(res_path), cb, getLoadPriority());
 }
 
 
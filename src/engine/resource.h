@@ -65,6 +65,7 @@ protected:
 	virtual void onBeforeEmpty() {}
 	virtual void unload() = 0;
 	virtual bool load(u64 size, const u8* mem) = 0;
+	virtual FileSystem::Priority getLoadPriority() const { return FileSystem::Priority::NORMAL; }
 
 	void onCreated(State state);
 	void doUnload();
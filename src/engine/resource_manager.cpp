@@ -210,6 +210,16 @@ void ResourceManagerHub::enableUnload(bool enable)
 	}
 }
 
+u64 ResourceManagerHub::getResidentSize() const
+{
+	u64 size = 0;
+	for (const ResourceManager* manager : m_resource_managers)
+	{
+		size += manager->getResidentSize();
+	}
+	return size;
+}
+
 void ResourceManagerHub::reload(const Path& path)
 {
 	for (auto* manager : m_resource_managers)
@@ -26,6 +26,8 @@ public:
 	void reload(const Path& path);
 	void reload(Resource& resource);
 	ResourceTable& getResourceTable() { return m_resources; }
+	// sum of sizes of loaded resources
+	u64 getResidentSize() const { return m_resident_size; }
 
 	explicit ResourceManager(IAllocator& allocator);
 	virtual ~ResourceManager();
@@ -42,6 +44,7 @@ protected:
 	ResourceTable m_resources;
 	ResourceManagerHub* m_owner;
 	bool m_is_unload_enabled;
+	u64 m_resident_size = 0;
 };
 
 
@@ -84,6 +87,8 @@ public:
 	void reload(const Path& path);
 	void removeUnreferenced();
 	void enableUnload(bool enable);
+	// sum of sizes of loaded resources of all types
+	u64 getResidentSize() const;
 
 	FileSystem& getFileSystem() { return *m_file_system; }
 
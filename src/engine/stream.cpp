@@ -73,6 +73,35 @@ IOutputStream& IOutputStream::operator << (const char* str)
 }
 
 
+void writeJSONString(IOutputStream& out, const char* str)
+{
+	out << "\"";
+	const char* run = str;
+	for (const char* c = str; *c; ++c) {
+		char tmp[] = "\\u0000";
+		const char* escaped = tmp;
+		switch (*c) {
+			case '"': escaped = "\\\""; break;
+			case '\\': escaped = "\\\\"; break;
+			case '\n': escaped = "\\n"; break;
+			case '\r': escaped = "\\r"; break;
+			case '\t': escaped = "\\t"; break;
+			default: {
+				if ((u8)*c >= 0x20) continue;
+				static const char hex[] = "0123456789abcdef";
+				tmp[4] = hex[(u8)*c >> 4];
+				tmp[5] = hex[(u8)*c & 0xf];
+				break;
+			}
+		}
+		out.write(run, c - run);
+		out << escaped;
+		run = c + 1;
+	}
+	out << run << "\"";
+}
+
+
 IOutputStream& IOutputStream::operator << (i32 value)
 {
 	char tmp[20];
@@ -21,6 +21,10 @@ struct LUMIX_ENGINE_API IOutputStream {
 };
 
 
+// writes str as a quoted JSON string, with quotes, backslashes and control characters escaped
+LUMIX_ENGINE_API void writeJSONString(IOutputStream& out, const char* str);
+
+
 struct LUMIX_ENGINE_API IInputStream {
 	virtual bool read(void* buffer, u64 size) = 0;
 	virtual const void* getBuffer() const = 0;
@@ -125,16 +125,22 @@ StackNode* StackTree::getParent(StackNode* node)
 
 
 bool StackTree::getFunction(StackNode* node, Span<char> out, Ref<int> line)
+{
+	return getFunction(node->m_instruction, out, line);
+}
+
+
+bool StackTree::getFunction(void* instruction, Span<char> out, Ref<int> line)
 {
 	HANDLE process = GetCurrentProcess();
 	alignas(SYMBOL_INFO) u8 symbol_mem[sizeof(SYMBOL_INFO) + 256 * sizeof(char)] = {};
 	SYMBOL_INFO* symbol = reinterpret_cast<SYMBOL_INFO*>(symbol_mem);
 	symbol->MaxNameLen = 255;
 	symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
-	BOOL success = SymFromAddr(process, (DWORD64)(node->m_instruction), 0, symbol);
+	BOOL success = SymFromAddr(process, (DWORD64)instruction, 0, symbol);
 	IMAGEHLP_LINE64 line_info;
 	DWORD displacement;
-	if (SymGetLineFromAddr64(process, (DWORD64)(node->m_instruction), &displacement, &line_info))
+	if (SymGetLineFromAddr64(process, (DWORD64)instruction, &displacement, &line_info))
 	{
 		line = line_info.LineNumber;
 	}
@@ -798,7 +798,14 @@ void memCommit(void* ptr, size_t size) {
 	VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE);
 }
 
-void memRelease(void* ptr) {
+void memDecommit(void* ptr, size_t size) {
+	VirtualFree(ptr, size, MEM_DECOMMIT);
+}
+
+// large pages need SeLockMemoryPrivilege and must be requested at reserve time, so this is a noop
+void memAdviseHugePages(void* ptr, size_t size) {}
+
+void memRelease(void* ptr, size_t size) {
 	VirtualFree(ptr, 0, MEM_RELEASE);
 }
 
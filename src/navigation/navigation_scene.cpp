@@ -353,9 +353,15 @@ struct NavigationSceneImpl final : NavigationScene
 		PROFILE_FUNCTION();
 		if (paused) return;
 		
+		u32 active_agents = 0;
 		for (RecastZone& zone : m_zones) {
 			update(zone, time_delta);
+			if (!zone.crowd) continue;
+			for (i32 i = 0, c = zone.crowd->getAgentCount(); i < c; ++i) {
+				if (zone.crowd->getAgent(i)->active) ++active_agents;
+			}
 		}
+		profiler::counter("active crowd agents", active_agents);
 	}
 
 	void lateUpdate(RecastZone& zone, float time_delta) {
@@ -3,6 +3,7 @@
 #include <PxPhysicsAPI.h>
 
 #include "cooking/PxCooking.h"
+#include "engine/allocators.h"
 #include "engine/engine.h"
 #include "engine/log.h"
 #include "engine/lua_wrapper.h"
@@ -88,9 +89,9 @@ namespace Lumix
 	struct PhysicsSystemImpl final : PhysicsSystem
 	{
 		explicit PhysicsSystemImpl(Engine& engine)
-			: m_allocator(engine.getAllocator())
+			: m_allocator(engine.getAllocator(), "physics")
 			, m_engine(engine)
-			, m_manager(*this, engine.getAllocator())
+			, m_manager(*this, m_allocator)
 			, m_physx_allocator(m_allocator)
 		{
 			PhysicsScene::reflect();
@@ -208,7 +209,7 @@ namespace Lumix
 		}
 
 
-		IAllocator& m_allocator;
+		TagAllocator m_allocator;
 		physx::PxPhysics* m_physics;
 		physx::PxFoundation* m_foundation;
 		physx::PxControllerManager* m_controller_manager;
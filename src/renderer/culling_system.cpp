@@ -91,7 +91,7 @@ struct CullingSystemImpl final : CullingSystem
 			return &cell.spheres[count];
 		}
 
-		void* mem = m_page_allocator.allocate(true);
+		void* mem = m_page_allocator.allocate();
 		CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
 		new_cell->header.origin = cell.header.origin;
 		new_cell->header.indices = cell.header.indices;
@@ -126,7 +126,7 @@ struct CullingSystemImpl final : CullingSystem
 
 		auto iter = m_cell_map.find(i);
 		if (!iter.isValid()) {
-			void* mem = m_page_allocator.allocate(true);
+			void* mem = m_page_allocator.allocate();
 			CellPage* new_cell = new (Lumix::NewPlaceholder(), mem) CellPage;
 			new_cell->header.origin = i.pos * double(m_cell_size);
 			new_cell->header.indices = i;
@@ -159,7 +159,7 @@ struct CullingSystemImpl final : CullingSystem
 			if (cell.header.next) cell.header.next->header.prev = cell.header.prev;
 			m_cells.swapAndPopItem(&cell);
 			cell.~CellPage();
-			m_page_allocator.deallocate(&cell, true);
+			m_page_allocator.deallocate(&cell);
 		}
 		else {
 			const int idx = int(sphere - cell.spheres);
@@ -252,7 +252,7 @@ struct CullingSystemImpl final : CullingSystem
 				CellPage* tmp = iter;
 				iter = tmp->header.next;
 				tmp->~CellPage();
-				m_page_allocator.deallocate(tmp, true);
+				m_page_allocator.deallocate(tmp);
 			}
 		}
 	   
@@ -373,7 +373,7 @@ struct CullingSystemImpl final : CullingSystem
 					doCulling(cell, frustum.getRelative(cell.header.origin), result, list, cell.header.indices.type);
 				}
 			}
-		});
+		}, jobs::Priority::CRITICAL);
 
 		return list.detach();
 	}
@@ -401,7 +401,7 @@ void CullResult::free(PageAllocator& allocator)
 	while(i) {
 		CullResult* tmp = i;
 		i = i->header.next;
-		allocator.deallocate(tmp, true);
+		allocator.deallocate(tmp);
 	}
 }
 
@@ -865,9 +865,11 @@ FBXImporter::FBXImporter(StudioApp& app)
 
 
 static void ofbx_job_processor(ofbx::JobFunction fn, void*, void* data, u32 size, u32 count) {
-	jobs::forEach(count, 1, [data, size, fn](i32 i, i32){
+	jobs::parallelFor(count, [data, size, fn](i32 from, i32 to){
 		u8* ptr = (u8*)data;
-		fn(ptr + i * size);
+		for (i32 i = from; i < to; ++i) {
+			fn(ptr + i * size);
+		}
 	});
 }
 
@@ -883,7 +883,7 @@ struct TexturePlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			job->m_out_path = fs.getBasePath();
 			job->m_out_path << out_path;
 			jobs::SignalHandle signal = jobs::INVALID_HANDLE;
-			jobs::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, jobs::getWorkersCount() - 1);
+			jobs::runEx(job, &TextureTileJob::execute, &signal, m_tile_signal, jobs::ANY_WORKER, jobs::Priority::BACKGROUND);
 			m_tile_signal = signal;
 			return true;
 		}
@@ -1614,7 +1614,7 @@ struct ModelPlugin final : AssetBrowser::IPlugin, AssetCompiler::IPlugin
 			}
 
 			LUMIX_DELETE(plugin->m_app.getAllocator(), data);
-		}, &m_subres_signal, jobs::INVALID_HANDLE, 2);			
+		}, &m_subres_signal, jobs::INVALID_HANDLE, jobs::ANY_WORKER, jobs::Priority::BACKGROUND);			
 	}
 
 	static const char* getResourceFilePath(const char* str)
@@ -385,7 +385,7 @@ struct TernaryHelper {
 };
 
 
-void ParticleEmitter::update(float dt)
+void ParticleEmitter::update(float dt, IAllocator& frame_allocator)
 {
 	if (!m_resource || !m_resource->isReady()) return;
 	
@@ -405,14 +405,14 @@ void ParticleEmitter::update(float dt)
 	m_constants[0] = dt;
 	// TODO
 	m_instances_count = m_particles_count;
-	Array<u32> kill_list(m_allocator);
+	Array<u32> kill_list(frame_allocator);
 	kill_list.resize(4096);
 	volatile i32 kill_counter = 0;
 
 	volatile i32 counter = 0;
 	jobs::runOnWorkers([&](){
 		PROFILE_FUNCTION();
-		Array<float4> reg_mem(m_allocator);
+		Array<float4> reg_mem(frame_allocator);
 		reg_mem.resize(m_resource->getRegistersCount() * 256);
 		for (;;) {
 			const i32 from = atomicAdd(&counter, 1024);
@@ -575,13 +575,13 @@ int ParticleEmitter::getInstanceDataSizeBytes() const
 }
 
 
-void ParticleEmitter::fillInstanceData(float* data) {
+void ParticleEmitter::fillInstanceData(float* data, IAllocator& frame_allocator) {
 	if (m_particles_count == 0) return;
 
 	volatile i32 counter = 0;
 	jobs::runOnWorkers([&](){
 		PROFILE_FUNCTION();
-		Array<float4> reg_mem(m_allocator);
+		Array<float4> reg_mem(frame_allocator);
 		reg_mem.resize(m_resource->getRegistersCount() * 256);
 		for (;;) {
 			const i32 from = atomicAdd(&counter, 1024);
@@ -105,9 +105,9 @@ public:
 
 	void serialize(OutputMemoryStream& blob);
 	void deserialize(InputMemoryStream& blob, ResourceManagerHub& manager);
-	void update(float dt);
+	void update(float dt, IAllocator& frame_allocator);
 	void emit(const float* args);
-	void fillInstanceData(float* data);
+	void fillInstanceData(float* data, IAllocator& frame_allocator);
 	int getInstanceDataSizeBytes() const;
 	ParticleEmitterResource* getResource() const { return m_resource; }
 	void setResource(ParticleEmitterResource* res);
@@ -458,8 +458,8 @@ struct MTBucketArray
 	~MTBucketArray()
 	{
 		PROFILE_FUNCTION();
-		os::memRelease(m_values_mem);
-		os::memRelease(m_keys_mem);
+		os::memRelease(m_values_mem, 1024 * 1024 * 16);
+		os::memRelease(m_keys_mem, 1024 * 1024 * 16);
 	}
 
 	void clear() {
@@ -1273,6 +1273,9 @@ struct PipelineImpl final : Pipeline
 			void setup() override {}
 			void execute() override {
 				pipeline->m_last_frame_stats = pipeline->m_stats;
+				profiler::counter("draw calls", pipeline->m_stats.draw_call_count);
+				profiler::counter("visible instances", pipeline->m_stats.instance_count);
+				profiler::counter("triangles", pipeline->m_stats.triangle_count);
 			}
 
 			PipelineImpl* pipeline;
@@ -1756,7 +1759,7 @@ struct PipelineImpl final : Pipeline
 					dc.size = size;
 					dc.instances_count = emitter->getInstancesCount();
 					dc.slice = m_pipeline->m_renderer.allocTransient(emitter->getInstanceDataSizeBytes());
-					emitter->fillInstanceData((float*)dc.slice.ptr);
+					emitter->fillInstanceData((float*)dc.slice.ptr, m_pipeline->m_renderer.getFrameAllocator());
 				}
 			}
 
@@ -2349,7 +2352,7 @@ struct PipelineImpl final : Pipeline
 
 				PROFILE_FUNCTION();
 				if(m_cmds->header.size == 0 && m_cmds->header.next == nullptr) {
-					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(m_cmds, true);
+					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(m_cmds);
 					return;
 				}
 				
@@ -2387,7 +2390,7 @@ struct PipelineImpl final : Pipeline
 						}
 					}
 					CmdPage* next = page->header.next;
-					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page, true);
+					m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page);
 					page = next;
 				}
 				#undef READ
@@ -2545,7 +2548,7 @@ struct PipelineImpl final : Pipeline
 		gpu::BufferHandle m_ib;
 		gpu::BufferHandle m_vb;
 		u32 m_texture_offset;
-		Array<Probe> m_probes;
+		SmallArray<Probe, 8> m_probes;
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
 	};
@@ -2915,7 +2918,7 @@ struct PipelineImpl final : Pipeline
 				do {} while(false)
 			PROFILE_FUNCTION();
 			if(m_cmds->header.size == 0 && !m_cmds->header.next) {
-				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(m_cmds, true);
+				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(m_cmds);
 				return;
 			}
 
@@ -3050,7 +3053,7 @@ struct PipelineImpl final : Pipeline
 					}
 				}
 				CmdPage* next = page->header.next;
-				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page, true);
+				m_pipeline->m_renderer.getEngine().getPageAllocator().deallocate(page);
 				page = next;
 			}
 			#undef READ
@@ -3100,7 +3103,7 @@ struct PipelineImpl final : Pipeline
 		while (cmd_page->header.next) cmd_page = cmd_page->header.next;
 
 		if (cmd_page->header.size > 0 && cmd_page->header.bucket != sort_keys[0] >> 56) {
-			cmd_page->header.next = new (NewPlaceholder(), page_allocator.allocate(true))(CmdPage);
+			cmd_page->header.next = new (NewPlaceholder(), page_allocator.allocate())(CmdPage);
 			cmd_page = cmd_page->header.next;
 		}
 
@@ -3116,7 +3119,7 @@ struct PipelineImpl final : Pipeline
 
 		auto new_page = [&](u8 bucket){
 			cmd_page->header.size = int(out - cmd_page->data);
-			CmdPage* new_page = new (NewPlaceholder(), page_allocator.allocate(true)) CmdPage;
+			CmdPage* new_page = new (NewPlaceholder(), page_allocator.allocate()) CmdPage;
 			cmd_page->header.next = new_page;
 			cmd_page = new_page;
 			new_page->header.bucket = bucket;
@@ -3418,7 +3421,7 @@ struct PipelineImpl final : Pipeline
 		const i32 steps = (size + STEP - 1) / STEP;
 		PageAllocator& page_allocator = m_renderer.getEngine().getPageAllocator();
 
-		Array<CmdPage*> pages(m_allocator);
+		Array<CmdPage*> pages(m_renderer.getFrameAllocator());
 		pages.resize(steps);
 
 		volatile i32 iter = 0;
@@ -3429,7 +3432,7 @@ struct PipelineImpl final : Pipeline
 				if (from >= size) return;
 
 				const u32 step = from / STEP;
-				pages[step] = new (NewPlaceholder(), page_allocator.allocate(true))(CmdPage);
+				pages[step] = new (NewPlaceholder(), page_allocator.allocate())(CmdPage);
 				const i32 s = minimum(STEP, size - from);
 				createCommands(view, pages[step], renderables + from, sort_keys + from, s);
 			}
@@ -4004,7 +4007,7 @@ struct PipelineImpl final : Pipeline
 		PipelineImpl* m_pipeline;
 		CameraParams m_camera_params;
 		gpu::StateFlags m_render_state;
-		Array<Instance> m_instances;
+		SmallArray<Instance, 4> m_instances;
 		gpu::TextureHandle m_global_textures[16];
 		int m_global_textures_count = 0;
 		u32 m_define_mask = 0;
@@ -4142,7 +4145,7 @@ struct PipelineImpl final : Pipeline
 			}
 			result.end();
 			profiler::pushInt("count", total);
-		});
+		}, jobs::Priority::CRITICAL);
 	}
 
 	struct Histogram {
@@ -507,7 +507,7 @@ public:
 		{
 			for (auto* emitter : m_particle_emitters)
 			{
-				emitter->update(dt);
+				emitter->update(dt, m_engine.getFrameAllocator());
 			}
 		}
 	}
@@ -2413,7 +2413,7 @@ public:
 
 	void updateParticleEmitter(EntityRef entity, float dt) override {
 		if (!m_particle_emitters[entity]) return;
-		m_particle_emitters[entity]->update(dt);
+		m_particle_emitters[entity]->update(dt, m_engine.getFrameAllocator());
 	}
 
 	void setParticleEmitterPath(EntityRef entity, const Path& path) override
@@ -1,8 +1,9 @@
 #include "renderer.h"
 
+#include "engine/allocators.h"
 #include "engine/array.h"
 #include "engine/command_line_parser.h"
-#include "engine/crc32.h"
+#include "engine/hash.h"
 #include "engine/debug.h"
 #include "engine/engine.h"
 #include "engine/log.h"
@@ -101,7 +102,7 @@ struct TransientBuffer {
 		if (m_overflow.buffer) {
 			gpu::createBuffer(m_overflow.buffer, gpu::BufferFlags::NONE, nextPow2(m_overflow.size + m_size), nullptr);
 			gpu::update(m_overflow.buffer, m_overflow.data, m_overflow.size);
-			os::memRelease(m_overflow.data);
+			os::memRelease(m_overflow.data, 128 * 1024 * 1024);
 			m_overflow.data = nullptr;
 			m_overflow.commit = 0;
 		}
@@ -339,7 +340,9 @@ struct RendererImpl final : Renderer
 {
 	explicit RendererImpl(Engine& engine)
 		: m_engine(engine)
-		, m_allocator(engine.getAllocator())
+		, m_allocator(engine.getAllocator(), "renderer")
+		// one buffer for each FrameData, so memory lives until render thread is done with it
+		, m_frame_allocator(m_allocator, 3, 64 * 1024 * 1024)
 		, m_texture_manager(*this, m_allocator)
 		, m_pipeline_manager(*this, m_allocator)
 		, m_model_manager(*this, m_allocator)
@@ -679,7 +682,7 @@ struct RendererImpl final : Renderer
 	}
 
 	u32 createMaterialConstants(const MaterialConsts& data) override {
-		const u32 hash = crc32(&data, sizeof(data));
+		const u64 hash = hash64(&data, sizeof(data));
 		auto iter = m_material_buffer.map.find(hash);
 		u32 idx;
 		if(iter.isValid()) {
@@ -694,7 +697,7 @@ struct RendererImpl final : Renderer
 			idx = m_material_buffer.first_free;
 			m_material_buffer.first_free = m_material_buffer.data[m_material_buffer.first_free].next_free;
 			m_material_buffer.data[idx].ref_count = 0;
-			m_material_buffer.data[idx].hash = crc32(&data, sizeof(data));
+			m_material_buffer.data[idx].hash = hash;
 			m_material_buffer.map.insert(hash, idx);
 			m_cpu_frame->material_updates.push({idx, data});
 		}
@@ -706,7 +709,7 @@ struct RendererImpl final : Renderer
 		--m_material_buffer.data[idx].ref_count;
 		if (m_material_buffer.data[idx].ref_count > 0) return;
 			
-		const u32 hash = m_material_buffer.data[idx].hash;
+		const u64 hash = m_material_buffer.data[idx].hash;
 		m_material_buffer.data[idx].next_free = m_material_buffer.first_free;
 		m_material_buffer.first_free = idx;
 		m_material_buffer.map.erase(hash);
@@ -962,12 +965,15 @@ struct RendererImpl final : Renderer
 		ctx.addScene(scene.move());
 	}
 
+	IAllocator& getFrameAllocator() override { return m_frame_allocator; }
+
+	// jobs are destroyed by render thread and their memory is reclaimed in bulk when the frame allocator wraps around
 	void* allocJob(u32 size, u32 align) override {
-		return m_allocator.allocate_aligned(size, align);
+		return m_frame_allocator.allocate_aligned(size, align);
 	}
 
 	void deallocJob(void* job) override {
-		m_allocator.deallocate_aligned(job);
+		m_frame_allocator.deallocate_aligned(job);
 	}
 
 	const char* getName() const override { return "renderer"; }
@@ -1043,6 +1049,8 @@ struct RendererImpl final : Renderer
 
 	void render() {
 		FrameData& frame = *m_gpu_frame;
+		// includes overflow
+		profiler::counter("transient buffer (KB)", frame.transient_buffer.m_offset / 1024.0);
 		frame.transient_buffer.prepareToRender();
 		
 		gpu::MemoryStats mem_stats;
@@ -1127,6 +1135,7 @@ struct RendererImpl final : Renderer
 		}
 
 		jobs::incSignal(&m_cpu_frame->can_setup);
+		profiler::pushInt("render jobs", m_cpu_frame->jobs.size());
 		
 		m_cpu_frame = m_frames[(getFrameIndex(m_cpu_frame) + 1) % lengthOf(m_frames)].get();
 		jobs::runEx(this, [](void* ptr){
@@ -1135,10 +1144,12 @@ struct RendererImpl final : Renderer
 		}, &m_last_render, jobs::INVALID_HANDLE, 1);
 
 		jobs::wait(m_cpu_frame->can_setup);
+		m_frame_allocator.endFrame();
 	}
 
 	Engine& m_engine;
-	IAllocator& m_allocator;
+	TagAllocator m_allocator;
+	FrameAllocator m_frame_allocator;
 	Array<StaticString<32>> m_shader_defines;
 	Mutex m_shader_defines_mutex;
 	Array<StaticString<32>> m_layers;
@@ -1169,7 +1180,7 @@ struct RendererImpl final : Renderer
 		struct Data {
 			u32 ref_count;
 			union {
-				u32 hash;
+				u64 hash;
 				u32 next_free;
 			};
 		};
@@ -1178,7 +1189,7 @@ struct RendererImpl final : Renderer
 		gpu::BufferHandle staging_buffer = gpu::INVALID_BUFFER;
 		Array<Data> data;
 		int first_free;
-		HashMap<u32, u32> map;
+		HashMap<u64, u32> map;
 	} m_material_buffer;
 };
 
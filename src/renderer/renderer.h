@@ -60,6 +60,8 @@ struct LUMIX_RENDERER_API Renderer : IPlugin {
 	virtual gpu::BufferHandle getMaterialUniformBuffer() = 0;
 
 	virtual IAllocator& getAllocator() = 0;
+	// memory lives until render thread finishes the frame, must not be used from RenderJob::execute
+	virtual IAllocator& getFrameAllocator() = 0;
 	virtual MemRef allocate(u32 size) = 0;
 	virtual MemRef copy(const void* data, u32 size) = 0 ;
 	virtual void free(const MemRef& memory) = 0;
@@ -88,6 +90,7 @@ struct LUMIX_RENDERER_API Renderer : IPlugin {
 
 	virtual struct Engine& getEngine() = 0;
 
+	// jobs are allocated from per-frame memory, so they must be queued in the frame they are created in
 	template <typename T, typename... Args> T& createJob(Args&&... args) {
 		return *new (NewPlaceholder(), allocJob(sizeof(T), alignof(T))) T(static_cast<Args&&>(args)...);
 	}
@@ -110,6 +110,8 @@ struct LUMIX_RENDERER_API Texture final : Resource {
 private:
 	void unload() override;
 	bool load(u64 size, const u8* mem) override;
+	// textures are big, so smaller resources which wait for them are not blocked
+	FileSystem::Priority getLoadPriority() const override { return FileSystem::Priority::LOW; }
 	bool loadTGA(IInputStream& file);
 };
 